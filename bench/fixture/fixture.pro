@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = fixture
+
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+
+HEADERS += ./server.h
+
+SOURCES += ./main.cxx \
+           ./server.cxx
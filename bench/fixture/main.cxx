@@ -0,0 +1,43 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <QCoreApplication>
+#include <QHostAddress>
+
+#include "./server.h"
+
+
+int main(int argc, char * argv[]) {
+    QCoreApplication app(argc, argv);
+
+    /* Listen on the port given on the command-line, or let the operating
+     * system pick one. Either way, the port is written to stdout. */
+    quint16 port = 0;
+    if (argc > 1)
+        port = quint16(atoi(argv[1]));
+
+    FixtureServer server(&app);
+    if (!server.listen(QHostAddress::LocalHost, port)) {
+        fprintf(stderr, "Couldn't listen: %s\n", qPrintable(server.errorString()));
+        return -1;
+    }
+
+    fprintf(stdout, "%d\n", int(server.serverPort()));
+    fflush(stdout);
+
+    return app.exec();
+}
@@ -0,0 +1,171 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <QUrl>
+
+#include "./server.h"
+
+
+/* The smallest valid GIF there is; served for image assets. */
+static const char pixel[] = "GIF89a\x01\x00\x01\x00\x80\x00\x00\x00\x00\x00\xff\xff\xff"
+                            "!\xf9\x04\x01\x00\x00\x00\x00,\x00\x00\x00\x00\x01\x00\x01\x00"
+                            "\x00\x02\x02\x44\x01\x00;";
+
+
+/* Write a complete response to a socket. */
+static void reply(QTcpSocket * socket, int status, const char * type,
+                  const QByteArray & body, const QList<QByteArray> & headers = QList<QByteArray>()) {
+    QByteArray head = "HTTP/1.1 " + QByteArray::number(status) + (status == 200 ? " OK" : " Not Found") + "\r\n";
+
+    head += "Content-Type: " + QByteArray(type) + "\r\n";
+    head += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    head += "Cache-Control: no-store\r\n";
+    head += "Connection: keep-alive\r\n";
+
+    foreach (QByteArray header, headers)
+        head += header + "\r\n";
+
+    socket->write(head + "\r\n" + body);
+}
+
+
+/* Wrap a chunk of markup in an HTML document. */
+static QByteArray page(const QByteArray & head, const QByteArray & body) {
+    return "<!doctype html><html><head>" + head + "</head><body>" + body + "</body></html>";
+}
+
+
+void FixtureServer::incomingConnection(qintptr fd) {
+    QTcpSocket * socket = new QTcpSocket(this);
+    socket->setSocketDescriptor(fd);
+
+    QObject::connect(socket, SIGNAL(readyRead()),
+                     this, SLOT(onReadyRead()));
+    QObject::connect(socket, SIGNAL(disconnected()),
+                     this, SLOT(onDisconnected()));
+}
+
+
+void FixtureServer::onReadyRead() {
+    QTcpSocket * socket = (QTcpSocket *) this->sender();
+    QByteArray & buf = this->buffers[socket];
+
+    buf += socket->readAll();
+
+    /* Handle every complete request we've got. Request bodies aren't used
+     * for anything, but still have to be skipped. */
+    for (;;) {
+        int end = buf.indexOf("\r\n\r\n");
+        if (end < 0)
+            break;
+
+        QList<QByteArray> lines = buf.left(end).split('\n');
+        QList<QByteArray> request = lines.at(0).trimmed().split(' ');
+        int length = 0;
+
+        for (int i = 1; i < lines.size(); i++) {
+            QByteArray line = lines.at(i).trimmed();
+            if (line.toLower().startsWith("content-length:"))
+                length = line.mid(15).trimmed().toInt();
+        }
+
+        if (buf.size() < end + 4 + length)
+            break;
+
+        buf.remove(0, end + 4 + length);
+
+        if (request.size() < 2) {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        this->respond(socket, request.at(0), request.at(1));
+    }
+}
+
+
+void FixtureServer::onDisconnected() {
+    QTcpSocket * socket = (QTcpSocket *) this->sender();
+
+    this->buffers.remove(socket);
+    socket->deleteLater();
+}
+
+
+void FixtureServer::respond(QTcpSocket * socket, const QByteArray & method, const QByteArray & target) {
+    Q_UNUSED(method);
+
+    QUrl url = QUrl::fromEncoded(target);
+    QUrlQuery query(url);
+    QString path = url.path();
+
+    if (path == "/blank") {
+        reply(socket, 200, "text/html", page("", ""));
+    } else if (path == "/subresources") {
+        int n = query.queryItemValue("n").toInt();
+        QByteArray head, body;
+
+        for (int i = 0; i < n; i++) {
+            QByteArray id = QByteArray::number(i);
+
+            switch (i % 3) {
+            case 0:
+                body += "<img src=\"/asset/" + id + ".gif\">";
+                break;
+            case 1:
+                head += "<link rel=\"stylesheet\" href=\"/asset/" + id + ".css\">";
+                break;
+            default:
+                head += "<script src=\"/asset/" + id + ".js\"></script>";
+            }
+        }
+
+        reply(socket, 200, "text/html", page(head, body));
+    } else if (path.startsWith("/asset/")) {
+        if (path.endsWith(".gif"))
+            reply(socket, 200, "image/gif", QByteArray(pixel, sizeof(pixel) - 1));
+        else if (path.endsWith(".css"))
+            reply(socket, 200, "text/css", "body { margin: 0; }\n");
+        else
+            reply(socket, 200, "application/javascript", "void 0;\n");
+    } else if (path == "/nested") {
+        int depth = query.queryItemValue("depth").toInt();
+        QByteArray body = "<p>depth " + QByteArray::number(depth) + "</p>";
+
+        if (depth > 0)
+            body += "<iframe src=\"/nested?depth=" + QByteArray::number(depth - 1) + "\"></iframe>";
+
+        reply(socket, 200, "text/html", page("", body));
+    } else if (path == "/cookies") {
+        int n = query.queryItemValue("n").toInt();
+        int size = query.queryItemValue("size").toInt();
+        QList<QByteArray> headers;
+
+        for (int i = 0; i < n; i++)
+            headers += "Set-Cookie: c" + QByteArray::number(i) + "=" + QByteArray(size, 'x') + "; Path=/";
+
+        reply(socket, 200, "text/html", page("", ""), headers);
+    } else if (path == "/dom") {
+        int n = query.queryItemValue("n").toInt();
+        QByteArray body;
+        body.reserve(n * 48);
+
+        for (int i = 0; i < n; i++)
+            body += "<div class=\"item\"><span>item " + QByteArray::number(i) + "</span></div>";
+
+        reply(socket, 200, "text/html", page("", body));
+    } else {
+        reply(socket, 404, "text/plain", "not found\n");
+    }
+}
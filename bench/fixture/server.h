@@ -0,0 +1,64 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrlQuery>
+
+
+/* The FixtureServer class is a tiny HTTP/1.1 server generating synthetic
+ * pages for benchmarks. It only ever listens on the loopback interface, so
+ * benchmarks never depend on the network.
+ *
+ * Supported paths:
+ *
+ *   /blank                      An empty page.
+ *   /subresources?n=N           A page referencing N images, stylesheets and
+ *                               scripts, served from /asset/.
+ *   /nested?depth=D             A page with D levels of nested iframes.
+ *   /cookies?n=N&size=S         A page setting N cookies of S bytes each.
+ *   /dom?n=N                    A page with N elements of text content.
+ *
+ * Requests with absolute URLs (as sent to HTTP proxies) are served based on
+ * their path alone, so the server also works as a stand-in proxy. */
+class FixtureServer : public QTcpServer {
+    Q_OBJECT
+
+private:
+    /* Buffered, not yet handled input for each connection. */
+    QHash<QTcpSocket *, QByteArray> buffers;
+
+public:
+    /* Construct a new FixtureServer. */
+    FixtureServer(QObject * parent = NULL)
+        : QTcpServer(parent) {
+    }
+
+protected:
+    /* Accept a new connection. */
+    void incomingConnection(qintptr fd);
+
+private slots:
+    /* Handlers for socket signals. */
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    /* Generate the response to a request. */
+    void respond(QTcpSocket * socket, const QByteArray & method, const QByteArray & target);
+};
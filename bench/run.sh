@@ -0,0 +1,110 @@
+#!/usr/bin/env bash
+#
+# Runs the benchmark suite against a local fixture server and appends one
+# JSON object per benchmark to bench/results/<commit>.jsonl. Nothing here
+# touches the network; everything is served from 127.0.0.1.
+#
+# Environment variables:
+#
+#   KOALA     Path to the koala binary (default: build/koala).
+#   FIXTURE   Path to the fixture server (default: bench/fixture/fixture).
+#   OUT       Where to write results.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+KOALA=${KOALA:-$ROOT/build/koala}
+FIXTURE=${FIXTURE:-$ROOT/bench/fixture/fixture}
+SCRIPTS=$ROOT/bench/scripts
+
+COMMIT=$(git -C "$ROOT" rev-parse --short HEAD 2>/dev/null || echo unknown)
+OUT=${OUT:-$ROOT/bench/results/$COMMIT.jsonl}
+TMP=$(mktemp -d)
+
+mkdir -p "$(dirname "$OUT")"
+
+
+# Start the fixture server on a port of its choosing, and wait for it to
+# tell us which one.
+"$FIXTURE" > "$TMP/port" &
+FIXTURE_PID=$!
+trap 'kill $FIXTURE_PID 2>/dev/null; rm -rf "$TMP"' EXIT
+
+while [ ! -s "$TMP/port" ]; do
+    sleep 0.1
+done
+
+BASE=http://127.0.0.1:$(cat "$TMP/port")
+
+
+# Pick the results out of koala's output, tag them with the current commit,
+# and add them to the results file.
+record() {
+    sed -n 's/^{"bench":{\(.*\)}}$/{"commit":"'"$COMMIT"'",\1}/p' | tee -a "$OUT"
+}
+
+
+# Run a benchmark script: run <name> <script> [args..]
+run() {
+    local name=$1 script=$2
+    shift 2
+
+    "$KOALA" "$SCRIPTS/$script" "$name" "$@" < /dev/null 2>> "$TMP/log" | record
+}
+
+
+# Startup time is measured from the outside, as wall-clock time until the
+# process exits, averaged over a few runs.
+TIMEFORMAT=%R
+total=0
+
+for i in 1 2 3 4 5; do
+    t=$( { time "$KOALA" "$SCRIPTS/startup.js" startup < /dev/null > "$TMP/startup" 2>> "$TMP/log"; } 2>&1 )
+    total=$(awk "BEGIN { print $total + $t }")
+done
+
+sed 's/}}$/,"seconds":'"$(awk "BEGIN { print $total / 5 }")"'}}/' "$TMP/startup" | record
+
+
+# Page load throughput.
+run pages-blank pages.js "$BASE/blank" 200 8
+run pages-subresources pages.js "$BASE/subresources?n=60" 100 4
+run pages-nested pages.js "$BASE/nested?depth=8" 50 4
+run pages-cookies pages.js "$BASE/cookies?n=40&size=200" 100 4
+run pages-dom pages.js "$BASE/dom?n=20000" 20 2
+
+
+# Stdio round trips; everything koala writes to stdout is fed straight back
+# into its stdin.
+mkfifo "$TMP/fifo"
+"$KOALA" "$SCRIPTS/stdio.js" stdio 2000 < "$TMP/fifo" 2>> "$TMP/log" | tee "$TMP/stdio" > "$TMP/fifo" || true
+record < "$TMP/stdio"
+
+
+# Callback round trips.
+run callback callback.js "$BASE/blank" 10000
+
+
+# Load balancing over a pool of stand-in proxies (more fixture servers), one
+# of which is dead and should get ejected. Hosts under ".invalid" never
+# resolve, so requests only succeed if they really went through a proxy.
+for name in proxy1 proxy2 dead; do
+    "$FIXTURE" > "$TMP/$name" &
+    eval "${name}_PID=\$!"
+done
+
+while [ ! -s "$TMP/proxy1" ] || [ ! -s "$TMP/proxy2" ] || [ ! -s "$TMP/dead" ]; do
+    sleep 0.1
+done
+
+kill $dead_PID
+trap 'kill $FIXTURE_PID $proxy1_PID $proxy2_PID 2>/dev/null; rm -rf "$TMP"' EXIT
+
+run proxies proxies.js 200 8 \
+    "127.0.0.1:$(cat "$TMP/proxy1")" "127.0.0.1:$(cat "$TMP/proxy2")" "127.0.0.1:$(cat "$TMP/dead")"
+
+
+# Frame captures at 1280x720.
+run render-raw render.js "$BASE/dom?n=2000" 100 raw "$TMP"
+run render-png render.js "$BASE/dom?n=2000" 100 png "$TMP"
+run render-jpeg render.js "$BASE/dom?n=2000" 100 jpeg "$TMP"
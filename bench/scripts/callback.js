@@ -0,0 +1,35 @@
+/* Measures the cost of the C++ to JavaScript callback round trip, by having
+ * a frame call `confirm` repeatedly.
+ *
+ * Arguments: name, url, count */
+
+var common = require('./common.js');
+
+var name = koala.args[0];
+var url = koala.args[1];
+var total = parseInt(koala.args[2], 10) || 10000;
+
+var frame = koala.open(url);
+
+frame.intercept('confirm', function () {
+  return true;
+});
+
+
+frame.once('loaded', function () {
+  var start = common.now();
+
+  for (var i = 0; i < total; i++)
+    frame.window.confirm('benchmark');
+
+  var seconds = (common.now() - start) / 1000;
+  var stats = koala.stats().koala_callback_duration_seconds;
+
+  common.report(name, {
+    callbacks: total,
+    seconds: seconds,
+    callbacksPerSec: total / seconds,
+    latencyP50: stats.p50,
+    latencyP99: stats.p99
+  });
+});
@@ -0,0 +1,41 @@
+/* Helpers shared by all benchmark scripts. */
+
+
+/* High resolution clock, in milliseconds. */
+var now = (window.performance && window.performance.now)
+  ? window.performance.now.bind(window.performance)
+  : Date.now;
+
+
+/* Return the `q` quantile of a list of samples. */
+function quantile(samples, q) {
+  if (samples.length === 0)
+    return null;
+
+  var sorted = samples.slice().sort(function (a, b) { return a - b; });
+  return sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))];
+}
+
+
+/* Emit a benchmark result over the "bench" channel, along with a few
+ * process-wide figures, and exit. */
+function report(name, fields) {
+  var stats = koala.stats();
+  var out = { name: name };
+
+  for (var key in fields)
+    out[key] = fields[key];
+
+  out.peakRss = stats.koala_peak_resident_memory_bytes;
+  out.eventLoopLagP99 = stats.koala_event_loop_lag_seconds.p99;
+
+  koala.channel('bench').send(out);
+  koala.exit(0);
+}
+
+
+module.exports = {
+  now: now,
+  quantile: quantile,
+  report: report
+};
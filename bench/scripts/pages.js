@@ -0,0 +1,44 @@
+/* Loads the same page over and over, with a fixed number of frames in
+ * flight, and measures throughput.
+ *
+ * Arguments: name, url, count, concurrency */
+
+var common = require('./common.js');
+
+var name = koala.args[0];
+var url = koala.args[1];
+var total = parseInt(koala.args[2], 10) || 100;
+var concurrency = parseInt(koala.args[3], 10) || 4;
+
+var started = 0;
+var finished = 0;
+var start = common.now();
+
+
+function next() {
+  if (started >= total)
+    return;
+
+  started++;
+
+  var frame = koala.open(url);
+
+  frame.once('loaded', function () {
+    frame.element.parentNode.removeChild(frame.element);
+
+    if (++finished < total)
+      return next();
+
+    var seconds = (common.now() - start) / 1000;
+
+    common.report(name, {
+      pages: total,
+      seconds: seconds,
+      pagesPerSec: total / seconds
+    });
+  });
+}
+
+
+for (var i = 0; i < concurrency; i++)
+  next();
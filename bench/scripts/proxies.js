@@ -0,0 +1,44 @@
+/* Loads pages from many different hosts through a pool of proxies, and
+ * reports how requests were spread over them.
+ *
+ * Arguments: name, count, concurrency, proxies.. */
+
+var common = require('./common.js');
+
+var name = koala.args[0];
+var total = parseInt(koala.args[1], 10) || 100;
+var concurrency = parseInt(koala.args[2], 10) || 4;
+
+koala.proxies(koala.args.slice(3));
+
+var started = 0;
+var finished = 0;
+var start = common.now();
+
+
+function next() {
+  if (started >= total)
+    return;
+
+  var frame = koala.open('http://site-' + (started++) + '.invalid/subresources?n=6');
+
+  frame.once('loaded', function () {
+    frame.element.parentNode.removeChild(frame.element);
+
+    if (++finished < total)
+      return next();
+
+    var seconds = (common.now() - start) / 1000;
+
+    common.report(name, {
+      pages: total,
+      seconds: seconds,
+      pagesPerSec: total / seconds,
+      proxies: koala.proxies()
+    });
+  });
+}
+
+
+for (var i = 0; i < concurrency; i++)
+  next();
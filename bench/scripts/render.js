@@ -0,0 +1,54 @@
+/* Measures capture throughput by rendering the same frame repeatedly.
+ *
+ * Arguments: name, url, count, format, output directory */
+
+var common = require('./common.js');
+
+var name = koala.args[0];
+var url = koala.args[1];
+var total = parseInt(koala.args[2], 10) || 100;
+var format = koala.args[3] || 'png';
+var dir = koala.args[4] || '/tmp';
+
+var frame = koala.open(url, { width: 1280, height: 720 });
+
+
+/* Captures kept in flight at once; the renderer refuses new ones past a
+ * limit of its own. */
+var concurrency = 4;
+
+
+frame.once('loaded', function () {
+  var start = common.now();
+  var started = 0;
+  var done = 0;
+  var failed = 0;
+
+  function next() {
+    var path = dir + '/capture-' + started + '.' + format;
+    started++;
+
+    frame.render({ path: path, format: format }, function (err) {
+      if (err != null)
+        failed++;
+
+      if (started < total)
+        next();
+
+      if (++done < total)
+        return;
+
+      var seconds = (common.now() - start) / 1000;
+
+      common.report(name, {
+        captures: total,
+        failed: failed,
+        seconds: seconds,
+        capturesPerSec: total / seconds
+      });
+    });
+  }
+
+  for (var i = 0; i < concurrency && i < total; i++)
+    next();
+});
@@ -0,0 +1,7 @@
+/* Exits as soon as the runtime is up; used to measure startup time.
+ *
+ * Arguments: name */
+
+var common = require('./common.js');
+
+common.report(koala.args[0], {});
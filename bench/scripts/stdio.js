@@ -0,0 +1,36 @@
+/* Measures the round trip time of messages sent over stdout and echoed
+ * back on stdin by the benchmark driver.
+ *
+ * Arguments: name, count */
+
+var common = require('./common.js');
+
+var name = koala.args[0];
+var total = parseInt(koala.args[1], 10) || 1000;
+
+var channel = koala.channel('ping');
+var samples = [];
+var sent = 0;
+
+
+function ping() {
+  sent = common.now();
+  channel.send(samples.length);
+}
+
+
+channel.on('message', function () {
+  samples.push(common.now() - sent);
+
+  if (samples.length < total)
+    return ping();
+
+  common.report(name, {
+    messages: total,
+    rttP50: common.quantile(samples, 0.5),
+    rttP99: common.quantile(samples, 0.99)
+  });
+});
+
+
+ping();
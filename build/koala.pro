@@ -5,17 +5,42 @@ CONFIG += console
 CONFIG -= app_bundle
 QT += network webkitwidgets
 
+# shm_open lives in librt on older glibc versions.
+linux: LIBS += -lrt
+
 RESOURCES += ../qrc/koala.qrc
 
 HEADERS += ../src/cookies.h \
+           ../src/fingerprint.h \
+           ../src/frontier.h \
+           ../src/log.h \
+           ../src/metrics.h \
            ../src/network.h \
+           ../src/proxy.h \
+           ../src/render.h \
            ../src/sandbox.h \
+           ../src/scripts.h \
+           ../src/shm.h \
            ../src/stdio.h \
+           ../src/tls.h \
+           ../src/trace.h \
+           ../src/transport.h \
            ../src/util.h
 
 SOURCES += ../src/cookies.cxx \
+           ../src/fingerprint.cxx \
+           ../src/frontier.cxx \
+           ../src/log.cxx \
+           ../src/metrics.cxx \
            ../src/main.cxx \
            ../src/network.cxx \
+           ../src/proxy.cxx \
+           ../src/render.cxx \
            ../src/sandbox.cxx \
+           ../src/scripts.cxx \
+           ../src/shm.cxx \
            ../src/stdio.cxx \
+           ../src/tls.cxx \
+           ../src/trace.cxx \
+           ../src/transport.cxx \
            ../src/util.cxx
@@ -8,6 +8,20 @@ var handles = [];
 var frames = [];
 
 
+/* Log levels for each of the console methods we intercept. */
+var consoleLevels = {
+  debug: 'debug',
+  info: 'info',
+  log: 'info',
+  warn: 'warning',
+  error: 'error'
+};
+
+
+/* Callbacks for pending render jobs, keyed by job id. */
+var renders = {};
+
+
 /* The Frame "class" represents a frame on the web page. */
 function Frame(parent, ref) {
   this.parent = parent;
@@ -17,6 +31,7 @@ function Frame(parent, ref) {
   this.window = null;
   this.document = null;
 
+  this.__handle = null;
   this.__intercepts = {};
 
   util.Emitter.call(this);
@@ -47,6 +62,35 @@ Frame.prototype.intercept = function (name, fn) {
 };
 
 
+/* Capture the frame's contents to a file. The callback is invoked with an
+ * error (or null) and an object describing the written image. */
+Frame.prototype.render = function (options, callback) {
+  var ret = __bridge.renderFrame(this.__handle, options || {});
+
+  if (ret.error != null) {
+    var err = new Error('render: ' + ret.error);
+    if (callback != null)
+      setTimeout(callback.bind(null, err), 0);
+    return;
+  }
+
+  renders[ret.id] = callback || null;
+};
+
+
+/* Return a fingerprint of the frame's text, as a string of 16 hex digits,
+ * or null if the frame has no text (yet). Pages with nearly the same text
+ * get fingerprints only a few bits apart; see `koala.fingerprints`. */
+Frame.prototype.fingerprint = function () {
+  var ret = __bridge.fingerprintFrame(this.__handle);
+
+  if (ret.error != null)
+    throw new Error('fingerprint: ' + ret.error);
+
+  return ret.fingerprint != null ? ret.fingerprint : null;
+};
+
+
 /* Create a Frame instance for every frame inserted into the page. */
 __bridge.frameSpawned.connect(function (document, handle, parentHandle) {
   var parent = frames[handles.indexOf(parentHandle)] || null;
@@ -77,15 +121,28 @@ __bridge.frameSpawned.connect(function (document, handle, parentHandle) {
     frame.window = ref.window;
     frame.document = ref.document;
 
-    /* Make all `console.log` calls from inside this frame available under
-     * a "console" event. */
-    var log_ = ref.window.console.log.bind(ref.window.console);
+    /* Route console output from inside this frame through our logging
+     * pipeline, and make all `console.log` calls available under a
+     * "console" event. */
+    Object.keys(consoleLevels).forEach(function (method) {
+      ref.window.console[method] = function () {
+        var args = Array.prototype.slice.call(arguments);
+        __bridge.log(handle, consoleLevels[method], args.map(String).join(' '),
+                     String(ref.window.location), 0);
+
+        if (method === 'log')
+          frame.emit.apply(frame, ['console'].concat(args));
+      };
+    });
 
-    ref.window.console.log = function () {
-      var args = Array.prototype.slice.call(arguments);
-      log_.apply(null, args);
-      frame.emit.apply(frame, ['console'].concat(args));
-    }
+    /* Report uncaught errors at the error level, with the script and line
+     * they were thrown from. Cancelling the event keeps WebKit from also
+     * writing them to the console. */
+    ref.window.addEventListener('error', function (event) {
+      __bridge.log(handle, 'error', String(event.message),
+                   String(event.filename || ref.window.location), event.lineno | 0);
+      event.preventDefault();
+    });
 
     frame.emit('cleared');
   });
@@ -99,6 +156,7 @@ __bridge.frameSpawned.connect(function (document, handle, parentHandle) {
     frame.element = null;
     frame.window = null;
     frame.document = null;
+    frame.__handle = null;
 
     /* Zero out relevant indexes in `frames` and `handles`. */
     var i = frames.indexOf(frame);
@@ -117,6 +175,7 @@ __bridge.frameSpawned.connect(function (document, handle, parentHandle) {
   });
 
   /* Register the handle and the Frame instance. */
+  frame.__handle = handle;
   handles.push(handle);
   frames.push(frame);
 
@@ -142,4 +201,19 @@ __bridge.callbackRequested.connect(function (name, handle, args) {
 });
 
 
+/* Deliver render results. */
+__bridge.frameRendered.connect(function (id, result) {
+  var callback = renders[id];
+  delete renders[id];
+
+  if (callback == null)
+    return;
+
+  if (result.error != null)
+    callback(new Error('render: ' + result.error), null);
+  else
+    callback(null, result);
+});
+
+
 module.exports = Frame;
@@ -0,0 +1,79 @@
+var __bridge = window.__bridge;
+
+
+/* Native crawl frontier. */
+var handle = __bridge.getFrontier();
+
+
+/* The frontier is a queue of URLs to be crawled. URLs are normalized and
+ * de-duplicated as they're added, and handed out host by host, with a
+ * politeness delay between two URLs from the same host. */
+var frontier = {};
+
+
+/* Change the frontier's settings; see `Frontier::configure`. */
+frontier.configure = function (options) {
+  var err = handle.configure(options || {});
+  if (err)
+    throw new Error('frontier: ' + err);
+};
+
+
+/* Queue a URL or a list of URLs, skipping any that have been seen before.
+ * Returns the number of URLs queued. */
+frontier.add = function (urls) {
+  if (!Array.isArray(urls))
+    urls = [urls];
+
+  return handle.add(urls.map(String));
+};
+
+
+/* Take the next URL that's ready to be crawled, or return null if there
+ * isn't one yet. */
+frontier.next = function () {
+  return handle.next() || null;
+};
+
+
+/* Return the number of milliseconds until a URL is ready, or -1 if the
+ * frontier is empty. */
+frontier.wait = function () {
+  return handle.wait();
+};
+
+
+/* Set the politeness delay (in milliseconds) for a single host. Pass -1 to
+ * go back to the default. */
+frontier.delay = function (host, ms) {
+  handle.setHostDelay(String(host), ms | 0);
+};
+
+
+/* Call `callback` with the next URL as soon as one is ready. Returns false
+ * (without calling `callback`) if the frontier is empty, and calls it with
+ * null if the frontier runs empty while waiting. */
+frontier.take = function (callback) {
+  var wait = handle.wait();
+  if (wait < 0)
+    return false;
+
+  setTimeout(function () {
+    var url = handle.next();
+    if (url)
+      callback(url);
+    else if (!frontier.take(callback))
+      callback(null);
+  }, wait);
+
+  return true;
+};
+
+
+/* Return counts of queued, spilled, seen and duplicate URLs. */
+frontier.stats = function () {
+  return handle.stats();
+};
+
+
+module.exports = frontier;
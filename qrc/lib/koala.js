@@ -2,6 +2,7 @@ var __bridge = window.__bridge;
 
 var Channel = require('./channel.js');
 var Frame = require('./frame.js');
+var frontier = require('./frontier.js');
 var util = require('./util.js');
 
 
@@ -29,6 +30,86 @@ koala.open = function (url, options) {
 };
 
 
+/* Return the state of each upstream proxy in the pool, or replace the pool
+ * with a new list of proxies ("host:port", or "http://" and "socks5://"
+ * URLs). An empty list sends requests directly again. */
+koala.proxies = function (list) {
+  if (arguments.length === 0)
+    return __bridge.getProxies();
+
+  var err = __bridge.setProxies(list.map(String));
+  if (err)
+    throw new Error('proxies: ' + err);
+};
+
+
+/* Open connections to hosts ahead of time, so that the first request to each
+ * of them doesn't have to wait for DNS resolution and the TCP (and TLS)
+ * handshake. Accepts a host name, URL or a list of either. */
+koala.preconnect = function (hosts) {
+  if (!Array.isArray(hosts))
+    hosts = [hosts];
+
+  __bridge.preconnect(hosts.map(String));
+};
+
+
+/* Queue of URLs to crawl, with de-duplication and per-host politeness
+ * delays; see frontier.js. */
+koala.frontier = frontier;
+
+
+/* Native index of page fingerprints. */
+var fingerprints = __bridge.getFingerprints();
+
+
+/* Unwrap the result of a fingerprint lookup. */
+function fingerprintMatch(ret) {
+  if (ret.error != null)
+    throw new Error('fingerprints: ' + ret.error);
+
+  return ret.match != null ? ret.match : null;
+}
+
+
+/* Index of fingerprints returned by `Frame.prototype.fingerprint`, used to
+ * find near-duplicate pages. Distances (in bits) range from 0 to 3, and
+ * default to 3. Null fingerprints (of frames without text) never match,
+ * and are never stored. */
+koala.fingerprints = {
+  /* Return a stored fingerprint near the given one, or null. */
+  find: function (fp, k) {
+    if (fp == null)
+      return null;
+
+    return fingerprintMatch(fingerprints.lookup(String(fp), k != null ? k | 0 : 3));
+  },
+
+  /* Like `find`, but store the fingerprint if there's no match. */
+  check: function (fp, k) {
+    if (fp == null)
+      return null;
+
+    return fingerprintMatch(fingerprints.check(String(fp), k != null ? k | 0 : 3));
+  },
+
+  /* Store a fingerprint. */
+  add: function (fp) {
+    if (fp == null)
+      return;
+
+    var err = fingerprints.add(String(fp));
+    if (err)
+      throw new Error('fingerprints: ' + err);
+  },
+
+  /* Return the number of fingerprints stored. */
+  size: function () {
+    return fingerprints.size();
+  }
+};
+
+
 /* Create a new namespaced channel of communication. */
 koala.channel = function (name) {
   return Channel.open('' + name);
@@ -58,6 +139,14 @@ __bridge.cookiesChanged.connect(function (cookies) {
 });
 
 
+/* Return a snapshot of runtime metrics, keyed by metric name. Histograms
+ * are reported as objects holding `count`, `sum`, `max`, `p50`, `p90` and
+ * `p99`, with all durations in seconds. */
+koala.stats = function () {
+  return __bridge.getStats();
+};
+
+
 /* Kill the koala process. */
 koala.exit = function (code) {
   __bridge.exit(code | 0);
@@ -15,36 +15,57 @@
 #include <QNetworkCookie>
 
 #include "./cookies.h"
+#include "./metrics.h"
+#include "./trace.h"
+
+
+static Gauge cookieCount("koala_cookies", "Cookies currently in the cookie jar.");
 
 
 bool CookieJar::deleteCookie(const QNetworkCookie & cookie) {
+    TraceSpan span("cookies", "deleteCookie");
+
     bool ok = QNetworkCookieJar::deleteCookie(cookie);
     if (ok)
-        emit this->updated(this->allCookies());
+        this->publish();
 
     return ok;
 }
 
 
 bool CookieJar::insertCookie(const QNetworkCookie & cookie) {
+    TraceSpan span("cookies", "insertCookie");
+
     bool ok = QNetworkCookieJar::insertCookie(cookie);
     if (ok)
-        emit this->updated(this->allCookies());
+        this->publish();
 
     return ok;
 }
 
 
 bool CookieJar::updateCookie(const QNetworkCookie & cookie) {
+    TraceSpan span("cookies", "updateCookie");
+
     bool ok = QNetworkCookieJar::updateCookie(cookie);
     if (ok)
-        emit this->updated(this->allCookies());
+        this->publish();
 
     return ok;
 }
 
 
 void CookieJar::setAllCookies(const QList<QNetworkCookie> & cookies) {
+    TraceSpan span("cookies", "setAllCookies");
+
     QNetworkCookieJar::setAllCookies(cookies);
-    emit this->updated(this->allCookies());
+    this->publish();
+}
+
+
+void CookieJar::publish() {
+    QList<QNetworkCookie> cookies = this->allCookies();
+
+    cookieCount.set(cookies.size());
+    emit this->updated(cookies);
 }
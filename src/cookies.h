@@ -41,6 +41,10 @@ public:
     /* Overwrite the cookie jar. */
     void setAllCookies(const QList<QNetworkCookie> & cookies);
 
+private:
+    /* Emit the jar's current contents through `updated`. */
+    void publish();
+
 signals:
     /* Signal used to indicate that the jar's contents have changed. */
     void updated(QList<QNetworkCookie> cookies);
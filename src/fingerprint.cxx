@@ -0,0 +1,206 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <QtAlgorithms>
+
+#include "./fingerprint.h"
+#include "./metrics.h"
+#include "./util.h"
+
+
+static Counter nearDuplicates("koala_fingerprint_near_duplicates_total", "Fingerprint lookups which found a near-duplicate.");
+static Gauge indexSize("koala_fingerprint_index_size", "Fingerprints stored in the near-duplicate index.");
+static Histogram simhashDuration("koala_fingerprint_duration_seconds", "Time spent computing a text's fingerprint.");
+
+
+/* Number of words per shingle. */
+static const int shingleSize = 3;
+
+
+bool simhash(const QString & text, quint64 & fp) {
+    qint64 started = Metrics::now();
+
+    /* Hash each word (a run of letters and digits), ignoring case. */
+    QVector<quint64> words;
+    quint64 word = fnvOffset;
+    bool inWord = false;
+
+    const QChar * chars = text.constData();
+    int length = text.size();
+
+    for (int i = 0; i <= length; i++) {
+        if (i < length && chars[i].isLetterOrNumber()) {
+            word ^= chars[i].toLower().unicode();
+            word *= fnvPrime;
+            inWord = true;
+        } else if (inWord) {
+            words.append(word);
+            word = fnvOffset;
+            inWord = false;
+        }
+    }
+
+    /* Text without any words would match all other such texts, so it
+     * doesn't get a fingerprint at all. */
+    if (words.isEmpty()) {
+        simhashDuration.record(Metrics::now() - started);
+        return false;
+    }
+
+    /* Count how often each bit is set across all shingle hashes; bits set
+     * in more than half of them are set in the fingerprint. */
+    int shingles = qMax(1, words.size() - shingleSize + 1);
+    int counts[64] = {0};
+
+    for (int i = 0; i < shingles; i++) {
+        quint64 hash = 0;
+
+        for (int j = i; j < i + shingleSize && j < words.size(); j++)
+            hash = mix64(hash ^ words[j]);
+
+        for (int b = 0; b < 64; b++)
+            counts[b] += int((hash >> b) & 1);
+    }
+
+    fp = 0;
+
+    for (int b = 0; b < 64; b++) {
+        if (2 * counts[b] > shingles)
+            fp |= Q_UINT64_C(1) << b;
+    }
+
+    simhashDuration.record(Metrics::now() - started);
+
+    return true;
+}
+
+
+FingerprintIndex::FingerprintIndex(QObject * parent)
+    : QObject(parent)
+    , buckets(4 << 16)
+    , count(0) {
+}
+
+
+QString FingerprintIndex::format(quint64 fp) {
+    return QString("%1").arg(fp, 16, 16, QChar('0'));
+}
+
+
+bool FingerprintIndex::parse(const QString & str, quint64 & fp) {
+    bool ok = false;
+
+    if (str.size() == 16)
+        fp = str.toULongLong(&ok, 16);
+
+    return ok;
+}
+
+
+bool FingerprintIndex::find(quint64 fp, int k, quint64 & match) const {
+    int best = k + 1;
+
+    for (int block = 0; block < 4; block++) {
+        const QVector<quint64> & bucket = this->buckets[(block << 16) | ((fp >> (16 * block)) & 0xffff)];
+
+        for (int i = 0; i < bucket.size(); i++) {
+            int distance = int(qPopulationCount(bucket[i] ^ fp));
+
+            if (distance < best) {
+                best = distance;
+                match = bucket[i];
+
+                if (distance == 0)
+                    return true;
+            }
+        }
+    }
+
+    return best <= k;
+}
+
+
+void FingerprintIndex::insert(quint64 fp) {
+    quint64 match;
+    if (this->find(fp, 0, match))
+        return;
+
+    for (int block = 0; block < 4; block++)
+        this->buckets[(block << 16) | ((fp >> (16 * block)) & 0xffff)].append(fp);
+
+    this->count++;
+    indexSize.set(this->count);
+}
+
+
+QVariantMap FingerprintIndex::lookup(const QString & str, int k) {
+    QVariantMap out;
+    quint64 fp, match;
+
+    if (this->prepare(str, k, fp, out) && this->find(fp, k, match)) {
+        out["match"] = FingerprintIndex::format(match);
+        nearDuplicates.add();
+    }
+
+    return out;
+}
+
+
+QVariantMap FingerprintIndex::check(const QString & str, int k) {
+    QVariantMap out;
+    quint64 fp, match;
+
+    if (!this->prepare(str, k, fp, out))
+        return out;
+
+    if (this->find(fp, k, match)) {
+        out["match"] = FingerprintIndex::format(match);
+        nearDuplicates.add();
+    } else {
+        this->insert(fp);
+    }
+
+    return out;
+}
+
+
+QString FingerprintIndex::add(const QString & str) {
+    quint64 fp;
+    if (!FingerprintIndex::parse(str, fp))
+        return "invalid fingerprint";
+
+    this->insert(fp);
+
+    return QString();
+}
+
+
+int FingerprintIndex::size() const {
+    return this->count;
+}
+
+
+bool FingerprintIndex::prepare(const QString & str, int k, quint64 & fp, QVariantMap & out) const {
+    if (!FingerprintIndex::parse(str, fp)) {
+        out["error"] = "invalid fingerprint";
+        return false;
+    }
+
+    if (k < 0 || k > maxDistance) {
+        out["error"] = QString("distance must be between 0 and %1").arg(maxDistance);
+        return false;
+    }
+
+    return true;
+}
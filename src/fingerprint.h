@@ -0,0 +1,82 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+
+/* Compute a 64-bit SimHash of a text, over shingles of three consecutive
+ * words. Texts which differ in only a few words end up with fingerprints
+ * only a few bits apart. Returns false if the text has no words. */
+bool simhash(const QString & text, quint64 & fp);
+
+
+/* The FingerprintIndex class stores page fingerprints, and finds stored
+ * fingerprints within a small Hamming distance of a given one.
+ *
+ * Fingerprints are split into four 16-bit blocks, and each block indexes a
+ * table of its own. Two fingerprints at most three bits apart must have at
+ * least one block in common, so a lookup only has to compare against the
+ * four buckets sharing a block with the fingerprint, rather than against
+ * every stored fingerprint. This also limits lookups to distances of 3 or
+ * less. */
+class FingerprintIndex : public QObject {
+    Q_OBJECT
+
+private:
+    /* Buckets of fingerprints, by block number and block value. */
+    QVector<QVector<quint64> > buckets;
+
+    /* Number of fingerprints stored. */
+    int count;
+
+public:
+    /* Maximum distance supported by lookups. */
+    static const int maxDistance = 3;
+
+    /* Construct an empty FingerprintIndex. */
+    FingerprintIndex(QObject * parent = NULL);
+
+    /* Convert fingerprints to and from strings of 16 hex digits, which is
+     * how they're passed to JavaScript. */
+    static QString format(quint64 fp);
+    static bool parse(const QString & str, quint64 & fp);
+
+    /* Look for a stored fingerprint within distance `k` of `fp`, returning
+     * whether one was found (along with the closest one, in `match`). */
+    bool find(quint64 fp, int k, quint64 & match) const;
+
+    /* Store a fingerprint, unless it's already stored. */
+    void insert(quint64 fp);
+
+public slots:
+    /* Versions of the above used by the JavaScript runtime. The lookups
+     * return an object holding either the `match` found (if any), or an
+     * `error` message; `check` also stores the fingerprint if there wasn't
+     * a match. */
+    QVariantMap lookup(const QString & fp, int k);
+    QVariantMap check(const QString & fp, int k);
+    QString add(const QString & fp);
+
+    /* Return the number of fingerprints stored. */
+    int size() const;
+
+private:
+    /* Parse and validate arguments for `lookup` and `check`. */
+    bool prepare(const QString & str, int k, quint64 & fp, QVariantMap & out) const;
+};
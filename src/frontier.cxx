@@ -0,0 +1,401 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <QDateTime>
+#include <QDir>
+#include <QTemporaryFile>
+#include <QUrl>
+#include <limits.h>
+#include <math.h>
+
+#include "./frontier.h"
+#include "./metrics.h"
+#include "./util.h"
+
+
+static Gauge queuedUrls("koala_frontier_queued_urls", "URLs queued in the crawl frontier's memory.");
+static Gauge spilledUrls("koala_frontier_spilled_urls", "URLs queued in the crawl frontier's spill file.");
+static Counter duplicateUrls("koala_frontier_duplicates_total", "URLs rejected by the crawl frontier as already seen.");
+
+
+/* Natural logarithm of 2. */
+static const double ln2 = 0.69314718055994530942;
+
+
+/* Return the approximate memory used by a queued URL. */
+static qint64 costOf(const QString & url) {
+    return 2 * url.size() + 64;
+}
+
+
+Frontier::Frontier(QObject * parent)
+    : QObject(parent)
+    , pruneAt(1024)
+    , delay(1000)
+    , queued(0)
+    , memory(0)
+    , memoryLimit(256 * 1024 * 1024)
+    , spill(NULL)
+    , spillPos(0)
+    , spillEnd(0)
+    , spilled(0)
+    , exact(false)
+    , added(0)
+    , duplicates(0) {
+    this->resizeBloom(1 << 20, 1e-4);
+}
+
+
+Frontier::~Frontier() {
+    if (this->spill != NULL)
+        this->spill->remove();
+}
+
+
+QString Frontier::normalize(const QString & raw) {
+    QUrl url(raw.trimmed());
+
+    QString scheme = url.scheme().toLower();
+    if (!url.isValid() || (scheme != "http" && scheme != "https") || url.host().isEmpty())
+        return QString();
+
+    url.setScheme(scheme);
+    url.setHost(url.host().toLower());
+
+    if (url.port() == (scheme == "https" ? 443 : 80))
+        url.setPort(-1);
+    if (url.path().isEmpty())
+        url.setPath("/");
+
+    return url.adjusted(QUrl::RemoveFragment | QUrl::NormalizePathSegments)
+              .toString(QUrl::FullyEncoded);
+}
+
+
+QString Frontier::configure(const QVariantMap & options) {
+    /* Check everything before changing anything. */
+    qint64 delay = options.value("delay", this->delay).toLongLong();
+    if (delay < 0)
+        return "invalid delay";
+
+    qint64 memoryLimit = options.value("memory", this->memoryLimit).toLongLong();
+    if (memoryLimit <= 0)
+        return "invalid memory limit";
+
+    QString spillPath = options.value("spill", this->spillPath).toString();
+    if (spillPath != this->spillPath && this->spilled > 0)
+        return "can't move the spill file while URLs are spilled";
+
+    /* We create (and remove) the spill file ourselves, so never touch one
+     * which is already there. */
+    if (spillPath != this->spillPath && !spillPath.isEmpty() && QFile::exists(spillPath))
+        return "spill file already exists";
+
+    bool seenChanged = options.contains("seen") || options.contains("capacity") ||
+                       options.contains("errorRate");
+
+    QString seen = options.value("seen", this->exact ? "exact" : "bloom").toString();
+    if (seen != "exact" && seen != "bloom")
+        return "invalid seen-set";
+
+    qint64 capacity = options.value("capacity", 1 << 20).toLongLong();
+    double errorRate = options.value("errorRate", 1e-4).toDouble();
+
+    if (capacity <= 0)
+        return "invalid capacity";
+    if (!(errorRate > 0.0 && errorRate < 1.0))
+        return "invalid error rate";
+
+    if (seenChanged && this->added > 0)
+        return "can't change the seen-set once URLs have been added";
+
+    /* Apply the new settings. */
+    this->delay = delay;
+    this->memoryLimit = memoryLimit;
+
+    if (spillPath != this->spillPath) {
+        if (this->spill != NULL) {
+            this->spill->remove();
+            delete this->spill;
+            this->spill = NULL;
+        }
+
+        this->spillPath = spillPath;
+        this->spillPos = 0;
+        this->spillEnd = 0;
+    }
+
+    if (seenChanged) {
+        this->exact = seen == "exact";
+        this->seenExact.clear();
+
+        if (this->exact)
+            this->bloom = QVector<quint64>();
+        else
+            this->resizeBloom(capacity, errorRate);
+    }
+
+    this->refill();
+
+    return QString();
+}
+
+
+void Frontier::setHostDelay(const QString & host, int delay) {
+    this->hosts[host.toLower()].delay = qMax(-1, delay);
+}
+
+
+int Frontier::add(const QStringList & urls) {
+    int count = 0;
+
+    foreach (QString raw, urls) {
+        QString url = Frontier::normalize(raw);
+        if (url.isNull())
+            continue;
+
+        if (this->see(fnv1a(url.toUtf8()))) {
+            this->duplicates++;
+            duplicateUrls.add();
+            continue;
+        }
+
+        this->added++;
+        count++;
+
+        /* Once anything has been spilled, keep spilling until the spill file
+         * has been drained, so that URLs are still handed out in order. */
+        if (this->spilled > 0 || this->memory + costOf(url) > this->memoryLimit) {
+            if (this->spillUrl(url))
+                continue;
+        }
+
+        this->enqueue(url);
+    }
+
+    /* URLs may have been spilled while nothing was queued in memory. */
+    this->refill();
+
+    queuedUrls.set(this->queued);
+    spilledUrls.set(this->spilled);
+
+    return count;
+}
+
+
+QString Frontier::next() {
+    this->refill();
+
+    if (this->ready.isEmpty())
+        return QString();
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMultiMap<qint64, QString>::iterator it = this->ready.begin();
+
+    if (it.key() > now)
+        return QString();
+
+    QString name = it.value();
+    this->ready.erase(it);
+
+    Host & host = this->hosts[name];
+    QString url = host.urls.dequeue();
+
+    this->queued--;
+    this->memory -= costOf(url);
+
+    host.readyAt = now + (host.delay >= 0 ? host.delay : this->delay);
+    if (!host.urls.isEmpty())
+        this->ready.insert(host.readyAt, name);
+
+    if (this->hosts.size() >= this->pruneAt)
+        this->prune(now);
+
+    this->refill();
+
+    queuedUrls.set(this->queued);
+    spilledUrls.set(this->spilled);
+
+    return url;
+}
+
+
+int Frontier::wait() {
+    this->refill();
+
+    if (this->ready.isEmpty())
+        return -1;
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    return int(qMax(Q_INT64_C(0), this->ready.begin().key() - now));
+}
+
+
+QVariantMap Frontier::stats() {
+    QVariantMap stats;
+
+    stats["queued"] = this->queued;
+    stats["spilled"] = this->spilled;
+    stats["hosts"] = this->hosts.size();
+    stats["added"] = this->added;
+    stats["duplicates"] = this->duplicates;
+    stats["memory"] = this->memory;
+    stats["seen"] = this->exact ? "exact" : "bloom";
+
+    if (this->exact)
+        stats["seenBytes"] = qint64(this->seenExact.size()) * 8;
+    else
+        stats["seenBytes"] = qint64(this->bloom.size()) * 8;
+
+    return stats;
+}
+
+
+void Frontier::resizeBloom(qint64 capacity, double errorRate) {
+    /* The optimal number of bits for n items and false positive rate p is
+     * -n ln(p) / ln(2)^2, with (bits / n) ln(2) hash functions. */
+    double bits = -double(capacity) * log(errorRate) / (ln2 * ln2);
+    qint64 words = qMax(Q_INT64_C(1), qint64(ceil(bits / 64.0)));
+
+    /* Stay within what a QVector can allocate (a little under 2GB, header
+     * included), at the cost of a higher false positive rate for capacities
+     * beyond about 900 million URLs at the default rate. */
+    this->bloom = QVector<quint64>(int(qMin(words, qint64((INT_MAX - 64) / 8))), 0);
+    this->bloomBits = quint64(this->bloom.size()) * 64;
+    this->bloomHashes = qBound(1, qRound(double(this->bloomBits) / capacity * ln2), 32);
+}
+
+
+bool Frontier::see(quint64 hash) {
+    if (this->exact) {
+        if (this->seenExact.contains(hash))
+            return true;
+
+        this->seenExact.insert(hash);
+        return false;
+    }
+
+    /* Derive the filter's hash functions from two independent hashes, as
+     * h1 + i * h2 (Kirsch and Mitzenmacher). */
+    quint64 h2 = mix64(hash) | 1;
+    quint64 * words = this->bloom.data();
+    bool seen = true;
+
+    for (int i = 0; i < this->bloomHashes; i++) {
+        quint64 bit = (hash + quint64(i) * h2) % this->bloomBits;
+        quint64 mask = Q_UINT64_C(1) << (bit & 63);
+
+        if (!(words[bit >> 6] & mask)) {
+            words[bit >> 6] |= mask;
+            seen = false;
+        }
+    }
+
+    return seen;
+}
+
+
+void Frontier::enqueue(const QString & url) {
+    QString name = QUrl(url).host();
+    Host & host = this->hosts[name];
+
+    if (host.urls.isEmpty())
+        this->ready.insert(host.readyAt, name);
+
+    host.urls.enqueue(url);
+
+    this->queued++;
+    this->memory += costOf(url);
+}
+
+
+bool Frontier::spillUrl(const QString & url) {
+    if (this->spill == NULL) {
+        if (this->spillPath.isEmpty()) {
+            QTemporaryFile * file = new QTemporaryFile(QDir::tempPath() + "/koala-frontier-XXXXXX", this);
+            file->setAutoRemove(false);
+            this->spill = file;
+        } else {
+            /* The file may have appeared since `configure` checked. */
+            if (QFile::exists(this->spillPath))
+                return false;
+
+            this->spill = new QFile(this->spillPath, this);
+        }
+
+        if (!this->spill->open(QIODevice::ReadWrite)) {
+            delete this->spill;
+            this->spill = NULL;
+            return false;
+        }
+    }
+
+    /* Reads and writes share a file position, so move back to the end if a
+     * read has happened since the last write. */
+    if (this->spill->pos() != this->spillEnd)
+        this->spill->seek(this->spillEnd);
+
+    QByteArray line = url.toUtf8() + '\n';
+    if (this->spill->write(line) != line.size())
+        return false;
+
+    this->spillEnd += line.size();
+    this->spilled++;
+
+    return true;
+}
+
+
+void Frontier::refill() {
+    /* Always read at least one URL back in when nothing is queued in memory,
+     * however small the memory limit. */
+    if (this->spilled == 0 || (this->queued > 0 && this->memory >= this->memoryLimit / 2))
+        return;
+
+    this->spill->seek(this->spillPos);
+
+    while (this->spilled > 0 && (this->queued == 0 || this->memory < this->memoryLimit / 4 * 3)) {
+        QByteArray line = this->spill->readLine();
+        if (line.isEmpty()) {
+            this->spilled = 0;
+            break;
+        }
+
+        this->spilled--;
+        this->enqueue(QString::fromUtf8(line.trimmed()));
+    }
+
+    this->spillPos = this->spill->pos();
+
+    /* Start over once everything has been read back in. */
+    if (this->spilled == 0) {
+        this->spill->resize(0);
+        this->spillPos = 0;
+        this->spillEnd = 0;
+    }
+}
+
+
+void Frontier::prune(qint64 now) {
+    QHash<QString, Host>::iterator it = this->hosts.begin();
+
+    while (it != this->hosts.end()) {
+        if (it->urls.isEmpty() && it->delay < 0 && it->readyAt <= now)
+            it = this->hosts.erase(it);
+        else
+            ++it;
+    }
+
+    this->pruneAt = qMax(1024, 2 * this->hosts.size());
+}
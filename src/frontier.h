@@ -0,0 +1,153 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QQueue>
+#include <QSet>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+
+/* The Frontier class is a queue of URLs waiting to be crawled, exposed to
+ * scripts as `koala.frontier`.
+ *
+ * URLs are normalized before anything else, and each URL is only ever
+ * queued once. Which URLs have been seen is tracked by a Bloom filter of
+ * their 64-bit hashes by default (which may occasionally drop a URL that
+ * hasn't actually been seen), or by an exact set of hashes.
+ *
+ * Queued URLs are grouped by host, and a host's next URL isn't handed out
+ * until a politeness delay has passed since its previous one. Once queued
+ * URLs take up more than a set amount of memory, new ones are written to a
+ * spill file instead, and read back in as the queues drain. */
+class Frontier : public QObject {
+    Q_OBJECT
+
+private:
+    /* Queued URLs for a single host. */
+    struct Host {
+        QQueue<QString> urls;
+
+        /* When the host's next URL may be handed out. */
+        qint64 readyAt;
+
+        /* Politeness delay for this host, or -1 for the default. */
+        qint64 delay;
+
+        Host() : readyAt(0), delay(-1) {}
+    };
+
+    /* Queued URLs, by host. */
+    QHash<QString, Host> hosts;
+
+    /* Hosts with queued URLs, by when their next URL is ready. */
+    QMultiMap<qint64, QString> ready;
+
+    /* Hosts with empty queues are pruned once the table grows past this
+     * size, after their delay has passed. */
+    int pruneAt;
+
+    /* Default politeness delay, in milliseconds. */
+    qint64 delay;
+
+    /* Number of URLs queued in memory, the approximate memory they use, and
+     * the limit past which URLs are spilled to disk instead, in bytes. */
+    qint64 queued;
+    qint64 memory;
+    qint64 memoryLimit;
+
+    /* Spill file (a temporary file unless a path has been set), where its
+     * first unread URL starts and where it ends, and how many URLs it
+     * holds. */
+    QString spillPath;
+    QFile * spill;
+    qint64 spillPos;
+    qint64 spillEnd;
+    qint64 spilled;
+
+    /* Seen-set; either an exact set of hashes, or a Bloom filter with
+     * `bloomHashes` hash functions. */
+    bool exact;
+    QSet<quint64> seenExact;
+    QVector<quint64> bloom;
+    quint64 bloomBits;
+    int bloomHashes;
+
+    /* Counts of URLs queued and rejected as duplicates. */
+    qint64 added;
+    qint64 duplicates;
+
+public:
+    /* Construct a new Frontier. */
+    Frontier(QObject * parent = NULL);
+
+    /* Remove the spill file. */
+    ~Frontier();
+
+    /* Return the normalized form of a URL: with the scheme and host in lower
+     * case, default port, fragment and dot segments removed, and consistent
+     * percent-encoding. Returns a null string for anything but HTTP(S). */
+    static QString normalize(const QString & url);
+
+public slots:
+    /* Change settings, returning an error message if any are invalid.
+     * Recognized options are `delay` (in milliseconds), `memory` (in bytes),
+     * `spill` (the path of a file to create, and remove again once it's no
+     * longer needed), `seen` ("bloom" or "exact"), and `capacity` and
+     * `errorRate` for sizing the Bloom filter. The seen-set can't be changed
+     * once URLs have been added. */
+    QString configure(const QVariantMap & options);
+
+    /* Set the politeness delay for a single host, or -1 for the default. */
+    void setHostDelay(const QString & host, int delay);
+
+    /* Queue URLs that haven't been seen before. Returns the number queued. */
+    int add(const QStringList & urls);
+
+    /* Take the next URL whose host's delay has passed, or return a null
+     * string if there isn't one yet. */
+    QString next();
+
+    /* Return the number of milliseconds until `next` will return a URL, or
+     * -1 if there are no URLs queued. */
+    int wait();
+
+    /* Return counts of queued, spilled, seen and duplicate URLs. */
+    QVariantMap stats();
+
+private:
+    /* Size the Bloom filter for a number of URLs and false positive rate. */
+    void resizeBloom(qint64 capacity, double errorRate);
+
+    /* Record a URL's hash as seen, returning whether it already was. */
+    bool see(quint64 hash);
+
+    /* Put a normalized URL in its host's queue. */
+    void enqueue(const QString & url);
+
+    /* Write a normalized URL to the spill file. */
+    bool spillUrl(const QString & url);
+
+    /* Read spilled URLs back in, once there's room for them. */
+    void refill();
+
+    /* Remove idle hosts whose delay has passed. */
+    void prune(qint64 now);
+};
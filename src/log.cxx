@@ -0,0 +1,372 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "./log.h"
+#include "./metrics.h"
+
+
+/* Maximum number of records waiting to be written. Anything beyond this is
+ * dropped, rather than letting the queue grow without bounds. */
+static const int maxQueuedRecords = 65536;
+
+
+/* Number of records dropped so far, either due to rate limiting or because
+ * the writer couldn't keep up. */
+static Counter droppedRecords("koala_log_dropped_records_total", "Log records dropped due to rate limiting or a full queue.");
+
+
+/* Return the name of a log level. */
+static const char * levelName(LogLevel level) {
+    switch (level) {
+    case LogDebug:
+        return "debug";
+    case LogInfo:
+        return "info";
+    case LogWarning:
+        return "warning";
+    default:
+        return "error";
+    }
+}
+
+
+/* Encode a log record as a JSON object. */
+static QJsonObject recordToJson(const LogRecord & record) {
+    QJsonObject obj;
+
+    obj["level"] = QString(levelName(record.level));
+    obj["frame"] = record.frame;
+    obj["source"] = record.source;
+    if (record.line > 0)
+        obj["line"] = record.line;
+    obj["timestamp"] = double(record.timestamp);
+    obj["message"] = record.message;
+
+    return obj;
+}
+
+
+/* Abstract log destination. Sinks are only ever used from the writer
+ * thread, so they don't have to worry about locking. */
+class LogSink {
+public:
+    virtual ~LogSink() { }
+
+    /* Write a single record. */
+    virtual void write(const LogRecord & record) = 0;
+
+    /* Flush buffered output; called after every batch of records. */
+    virtual void flush() = 0;
+};
+
+
+/* Writes human-readable lines to stderr. */
+class StderrSink : public LogSink {
+public:
+    void write(const LogRecord & record) {
+        QString time = QDateTime::fromMSecsSinceEpoch(record.timestamp).toString("hh:mm:ss.zzz");
+
+        if (record.source.isEmpty()) {
+            fprintf(stderr, "%s %-7s [%d] %s\n", qPrintable(time), levelName(record.level),
+                    record.frame, qPrintable(record.message));
+        } else if (record.line <= 0) {
+            fprintf(stderr, "%s %-7s [%d] %s: %s\n", qPrintable(time), levelName(record.level),
+                    record.frame, qPrintable(record.source), qPrintable(record.message));
+        } else {
+            fprintf(stderr, "%s %-7s [%d] %s:%d: %s\n", qPrintable(time), levelName(record.level),
+                    record.frame, qPrintable(record.source), record.line, qPrintable(record.message));
+        }
+    }
+
+    void flush() {
+        fflush(stderr);
+    }
+};
+
+
+/* Appends records to a file, one JSON object per line. */
+class FileSink : public LogSink {
+public:
+    QFile file;
+
+    void write(const LogRecord & record) {
+        this->file.write(QJsonDocument(recordToJson(record)).toJson(QJsonDocument::Compact));
+        this->file.write("\n", 1);
+    }
+
+    void flush() {
+        this->file.flush();
+    }
+};
+
+
+/* Emits records as messages, wrapped in the same kind of envelope as used
+ * by `Channel.send`. The encoded messages are handed back to the GUI thread
+ * (through the Logger's `messageSent` signal) rather than written from here,
+ * so they go through StdioHelper like every other outgoing message. */
+class ChannelSink : public LogSink {
+public:
+    Logger * logger;
+    QString name;
+
+    void write(const LogRecord & record) {
+        QJsonObject envelope;
+        envelope[this->name] = recordToJson(record);
+
+        QString line = QString::fromUtf8(QJsonDocument(envelope).toJson(QJsonDocument::Compact));
+        QMetaObject::invokeMethod(this->logger, "messageSent", Qt::QueuedConnection,
+                                  Q_ARG(QString, line));
+    }
+
+    void flush() {
+    }
+};
+
+
+/* The LogWriter thread drains the record queue into a sink. */
+class LogWriter : public QThread {
+public:
+    LogSink * sink;
+
+    QMutex mutex;
+    QWaitCondition wake;
+    QVector<LogRecord> queue;
+    bool stopping;
+
+    LogWriter(LogSink * sink)
+        : sink(sink)
+        , stopping(false) {
+    }
+
+    ~LogWriter() {
+        delete this->sink;
+    }
+
+    /* Queue a record for writing. Returns false if the queue is full. */
+    bool push(const LogRecord & record) {
+        QMutexLocker lock(&this->mutex);
+
+        if (this->queue.size() >= maxQueuedRecords)
+            return false;
+
+        /* Only the first record of a batch needs to wake the writer. */
+        this->queue.append(record);
+        if (this->queue.size() == 1)
+            this->wake.wakeOne();
+
+        return true;
+    }
+
+    /* Write all queued records and stop the thread. */
+    void stop() {
+        this->mutex.lock();
+        this->stopping = true;
+        this->wake.wakeOne();
+        this->mutex.unlock();
+
+        this->wait();
+    }
+
+protected:
+    void run() {
+        for (;;) {
+            QVector<LogRecord> batch;
+            bool done;
+
+            this->mutex.lock();
+            while (this->queue.isEmpty() && !this->stopping)
+                this->wake.wait(&this->mutex);
+
+            batch.swap(this->queue);
+            done = this->stopping;
+            this->mutex.unlock();
+
+            for (int i = 0; i < batch.size(); i++)
+                this->sink->write(batch.at(i));
+
+            if (!batch.isEmpty())
+                this->sink->flush();
+
+            if (done)
+                break;
+        }
+    }
+};
+
+
+Logger::Logger(QObject * parent)
+    : QObject(parent)
+    , level(LogDebug)
+    , rate(0)
+    , pruneAt(1024)
+    , writer(new LogWriter(new StderrSink)) {
+    this->writer->start();
+}
+
+
+Logger::~Logger() {
+    this->writer->stop();
+    delete this->writer;
+
+    /* Deliver whatever the channel sink handed back to us on its way out. */
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+}
+
+
+QString Logger::setSink(const QString spec) {
+    LogSink * sink;
+
+    if (spec == "stderr") {
+        sink = new StderrSink;
+    } else if (spec.startsWith("file:")) {
+        FileSink * file = new FileSink;
+        file->file.setFileName(spec.mid(5));
+
+        if (!file->file.open(QFile::WriteOnly | QFile::Append)) {
+            QString err = file->file.errorString();
+            delete file;
+            return err;
+        }
+
+        sink = file;
+    } else if (spec.startsWith("channel:") && spec.size() > 8) {
+        ChannelSink * channel = new ChannelSink;
+        channel->logger = this;
+        channel->name = spec.mid(8);
+        sink = channel;
+    } else {
+        return QString("unknown log sink");
+    }
+
+    /* Replace the writer thread (after letting it finish its work). */
+    this->writer->stop();
+    delete this->writer;
+
+    this->writer = new LogWriter(sink);
+    this->writer->start();
+
+    return QString();
+}
+
+
+void Logger::setLevel(LogLevel level) {
+    this->level = level;
+}
+
+
+void Logger::setRate(int rate) {
+    this->rate = rate;
+    this->buckets.clear();
+}
+
+
+void Logger::log(LogLevel level, int frame, const QString & source, int line, const QString & message) {
+    if (level < this->level)
+        return;
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    quint64 dropped = 0;
+
+    if (!this->admit(frame, now, dropped)) {
+        droppedRecords.add();
+        return;
+    }
+
+    /* Let the reader know if anything was lost since this frame's last
+     * successfully logged record. */
+    if (dropped > 0) {
+        LogRecord notice = {
+            LogWarning, frame, QString(), 0, now,
+            QString("rate limit exceeded, dropped %1 records").arg(dropped)
+        };
+
+        if (!this->writer->push(notice))
+            droppedRecords.add();
+    }
+
+    LogRecord record = { level, frame, source, line, now, message };
+    if (!this->writer->push(record))
+        droppedRecords.add();
+}
+
+
+bool Logger::parseLevel(const QString name, LogLevel & level) {
+    if (name == "debug")
+        level = LogDebug;
+    else if (name == "info")
+        level = LogInfo;
+    else if (name == "warning")
+        level = LogWarning;
+    else if (name == "error")
+        level = LogError;
+    else
+        return false;
+
+    return true;
+}
+
+
+bool Logger::admit(int frame, qint64 now, quint64 & dropped) {
+    if (this->rate <= 0)
+        return true;
+
+    /* Get rid of buckets which have filled back up, as they're no different
+     * from freshly created ones. */
+    if (this->buckets.size() >= this->pruneAt) {
+        QHash<int, Bucket>::iterator it = this->buckets.begin();
+
+        while (it != this->buckets.end()) {
+            if (it->dropped == 0 && now - it->updated >= 1000)
+                it = this->buckets.erase(it);
+            else
+                ++it;
+        }
+
+        this->pruneAt = qMax(1024, 2 * this->buckets.size());
+    }
+
+    QHash<int, Bucket>::iterator it = this->buckets.find(frame);
+    if (it == this->buckets.end()) {
+        Bucket fresh = { double(this->rate), now, 0 };
+        it = this->buckets.insert(frame, fresh);
+    }
+
+    /* Refill the bucket according to the time passed since it was last
+     * touched, then try to take a token. */
+    it->tokens = qMin(double(this->rate), it->tokens + (now - it->updated) * this->rate / 1000.0);
+    it->updated = now;
+
+    if (it->tokens < 1.0) {
+        it->dropped++;
+        return false;
+    }
+
+    it->tokens -= 1.0;
+    dropped = it->dropped;
+    it->dropped = 0;
+
+    return true;
+}
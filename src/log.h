@@ -0,0 +1,124 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+
+/* Severity of a log record. */
+enum LogLevel {
+    LogDebug,
+    LogInfo,
+    LogWarning,
+    LogError
+};
+
+
+/* A single, structured log record. */
+struct LogRecord {
+    LogLevel level;
+
+    /* Identifier of the frame the record originated from, or 0 for the
+     * sandbox itself. */
+    int frame;
+
+    /* Where the message came from, if known. */
+    QString source;
+
+    /* Line number within `source`, or 0 if unknown. */
+    int line;
+
+    /* Milliseconds since the epoch. */
+    qint64 timestamp;
+
+    QString message;
+};
+
+
+class LogSink;
+class LogWriter;
+
+
+/* The Logger class is the entry point of our logging pipeline. Records are
+ * filtered and rate limited on the calling thread, which is cheap, and then
+ * queued for a background thread which takes care of formatting and writing
+ * them to the configured sink. That way even the chattiest of pages can't
+ * hold up the event loop with console output.
+ *
+ * Rate limiting is done per frame with a token bucket. Records that don't
+ * make it through are counted, and reported with a single warning once the
+ * frame is allowed to log again. */
+class Logger : public QObject {
+    Q_OBJECT
+
+private:
+    /* Rate limiting state for a single frame. */
+    struct Bucket {
+        double tokens;
+        qint64 updated;
+        quint64 dropped;
+    };
+
+    /* Minimum level of records to let through. */
+    LogLevel level;
+
+    /* Maximum number of records per second and frame, or 0 for no limit. */
+    int rate;
+
+    /* Rate limiting state, keyed by frame identifier. Buckets belonging to
+     * idle frames are pruned once the table grows past `pruneAt` entries. */
+    QHash<int, Bucket> buckets;
+    int pruneAt;
+
+    /* Background writer thread. */
+    LogWriter * writer;
+
+public:
+    /* Construct a new Logger, writing to stderr until told otherwise. */
+    Logger(QObject * parent = NULL);
+
+    /* Flush all pending records and stop the writer thread. */
+    ~Logger();
+
+    /* Set the log sink. Recognized values are "stderr", "file:<path>" and
+     * "channel:<name>"; the last one emits records as messages on a channel
+     * (see `messageSent`), same as `Channel.send` would. Returns an error
+     * message on failure. */
+    QString setSink(const QString spec);
+
+    /* Set the minimum level of records to let through. */
+    void setLevel(LogLevel level);
+
+    /* Set the per-frame rate limit, in records per second. */
+    void setRate(int rate);
+
+    /* Submit a new log record. */
+    void log(LogLevel level, int frame, const QString & source, int line, const QString & message);
+
+    /* Parse a level name ("debug", "info", "warning" or "error"). */
+    static bool parseLevel(const QString name, LogLevel & level);
+
+signals:
+    /* Emitted on the GUI thread for every record written to a channel sink,
+     * already encoded as an outgoing message. */
+    void messageSent(QString message);
+
+private:
+    /* Consume a token from the frame's bucket, returning false if there
+     * aren't any left. */
+    bool admit(int frame, qint64 now, quint64 & dropped);
+};
@@ -12,15 +12,22 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+#include <limits.h>
+
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QFileInfo>
 #include <QNetworkProxy>
 
 #include "./cookies.h"
+#include "./log.h"
+#include "./metrics.h"
 #include "./network.h"
 #include "./sandbox.h"
+#include "./scripts.h"
 #include "./stdio.h"
+#include "./tls.h"
+#include "./trace.h"
 #include "./util.h"
 
 
@@ -47,12 +54,38 @@ int main(int argc, char * argv[]) {
     /* Parse command-line options. */
     QCommandLineParser parser;
     QCommandLineOption proxyOption(QStringList() << "p" << "proxy", "Optional HTTP/HTTPS proxy.", "host:port");
+    QCommandLineOption proxiesOption("proxies", "File listing upstream proxies to balance requests over, one per line.", "file");
+    QCommandLineOption proxyStrategyOption("proxy-strategy", "How hosts are assigned to proxies.", "round-robin|least-outstanding", "round-robin");
     QCommandLineOption certificatesOption(QStringList() << "c" << "certificates", "Custom set of CA certificates.", "glob");
+    QCommandLineOption tlsSessionsOption("tls-sessions", "Persist TLS session tickets in a file between runs.", "file");
+    QCommandLineOption bundleOption(QStringList() << "b" << "bundle", "Load scripts from a bundle file.", "file");
+    QCommandLineOption writeBundleOption("write-bundle", "Pack all scripts loaded during the run into a bundle file.", "file");
+    QCommandLineOption metricsFileOption("metrics-file", "Periodically write metrics to a file, in Prometheus text format.", "file");
+    QCommandLineOption metricsIntervalOption("metrics-interval", "Interval between metrics file updates, in seconds.", "seconds", "10");
+    QCommandLineOption shmOption("shm", "Pass large messages through shared memory regions of this size.", "megabytes");
+    QCommandLineOption shmThresholdOption("shm-threshold", "Size from which messages are passed through shared memory.", "bytes", "65536");
+    QCommandLineOption traceOption("trace", "Write Chrome trace-event JSON to a file.", "file");
+    QCommandLineOption logLevelOption("log-level", "Minimum level of console output to log.", "debug|info|warning|error", "debug");
+    QCommandLineOption logSinkOption("log-sink", "Where to write console output.", "stderr|file:<path>|channel:<name>", "stderr");
+    QCommandLineOption logRateOption("log-rate", "Maximum number of console messages per second and frame (0 for no limit).", "n", "200");
 
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addOption(proxyOption);
+    parser.addOption(proxiesOption);
+    parser.addOption(proxyStrategyOption);
     parser.addOption(certificatesOption);
+    parser.addOption(tlsSessionsOption);
+    parser.addOption(bundleOption);
+    parser.addOption(writeBundleOption);
+    parser.addOption(logLevelOption);
+    parser.addOption(logSinkOption);
+    parser.addOption(logRateOption);
+    parser.addOption(shmOption);
+    parser.addOption(shmThresholdOption);
+    parser.addOption(traceOption);
+    parser.addOption(metricsFileOption);
+    parser.addOption(metricsIntervalOption);
 
     parser.addPositionalArgument("script", "The .js-file to be executed.");
     parser.addPositionalArgument("[args..]", "Optional command-line arguments for the script.");
@@ -64,14 +97,62 @@ int main(int argc, char * argv[]) {
         return -1;
     }
 
+    /* Start tracing before anything else, so that nothing is missed. */
+    if (parser.isSet(traceOption)) {
+        QString err = Tracer::open(parser.value(traceOption));
+        if (!err.isNull()) {
+            fprintf(stderr, "Couldn't open trace file %s: %s\n", qPrintable(parser.value(traceOption)), qPrintable(err));
+            return -1;
+        }
+    }
+
+    /* Start collecting metrics. */
+    MetricsReporter * metrics = new MetricsReporter(&app);
+
+    if (parser.isSet(metricsFileOption))
+        metrics->writeTo(parser.value(metricsFileOption), qMax(1, parser.value(metricsIntervalOption).toInt()) * 1000);
+
+    /* Set up the logging pipeline. */
+    Logger * logger = new Logger(&app);
+    LogLevel level;
+
+    if (!Logger::parseLevel(parser.value(logLevelOption), level)) {
+        fprintf(stderr, "Invalid log level: %s\n", qPrintable(parser.value(logLevelOption)));
+        return -1;
+    }
+
+    QString err = logger->setSink(parser.value(logSinkOption));
+    if (!err.isNull()) {
+        fprintf(stderr, "Couldn't open log sink %s: %s\n", qPrintable(parser.value(logSinkOption)), qPrintable(err));
+        return -1;
+    }
+
+    logger->setLevel(level);
+    logger->setRate(parser.value(logRateOption).toInt());
+
+    /* Set up the script store, which is where the main script and all its
+     * modules will be loaded from. */
+    ScriptStore * scripts = new ScriptStore(&app);
+
+    if (parser.isSet(bundleOption)) {
+        err = scripts->openBundle(parser.value(bundleOption));
+        if (!err.isNull()) {
+            fprintf(stderr, "Couldn't open bundle %s: %s\n", qPrintable(parser.value(bundleOption)), qPrintable(err));
+            return -1;
+        }
+    }
+
+    if (parser.isSet(writeBundleOption))
+        scripts->record();
+
     /* Read the main script file. */
     QFileInfo info(args.takeFirst());
     QString path = info.absoluteFilePath();
 
-    QByteArray buf;
-    QString err = readFileUtf8(path, buf);
+    QString src;
+    err = scripts->read(path, src);
     if (!err.isNull()) {
-        fprintf(stderr, "Couldn't read %s: %s\n", qPrintable(args.at(0)), qPrintable(err));
+        fprintf(stderr, "Couldn't read %s: %s\n", qPrintable(path), qPrintable(err));
         return -1;
     }
 
@@ -83,11 +164,15 @@ int main(int argc, char * argv[]) {
 
     network->setCookieJar(jar);
     sandbox->setNetworkAccessManager(network);
+    sandbox->setScriptStore(scripts);
+    sandbox->setLogger(logger);
 
     QObject::connect(stdio, SIGNAL(received(QString)),
                      sandbox, SIGNAL(messageReceived(QString)));
     QObject::connect(sandbox, SIGNAL(messageSent(QString)),
                      stdio, SLOT(send(QString)));
+    QObject::connect(logger, SIGNAL(messageSent(QString)),
+                     stdio, SLOT(send(QString)));
     QObject::connect(jar, SIGNAL(updated(QList<QNetworkCookie>)),
                      sandbox, SLOT(onCookiesChanged(QList<QNetworkCookie>)));
 
@@ -98,10 +183,44 @@ int main(int argc, char * argv[]) {
         QNetworkProxy::setApplicationProxy(proxy);
     }
 
+    /* Did the user provide a list of proxies to balance over? */
+    ProxyPool::Strategy strategy;
+    if (!ProxyPool::parseStrategy(parser.value(proxyStrategyOption), strategy)) {
+        fprintf(stderr, "Invalid proxy strategy: %s\n", qPrintable(parser.value(proxyStrategyOption)));
+        return -1;
+    }
+
+    network->proxies()->setStrategy(strategy);
+
+    if (parser.isSet(proxiesOption)) {
+        QByteArray list;
+        err = readFileUtf8(parser.value(proxiesOption), list);
+
+        QStringList proxies;
+        foreach (QString line, QString::fromUtf8(list).split('\n')) {
+            if (!line.trimmed().startsWith('#'))
+                proxies += line;
+        }
+
+        if (err.isNull())
+            err = network->proxies()->setProxies(proxies);
+
+        if (!err.isNull()) {
+            fprintf(stderr, "Couldn't load proxies %s: %s\n", qPrintable(parser.value(proxiesOption)), qPrintable(err));
+            return -1;
+        }
+    }
+
     /* Did the user specify a custom set of certificate authorities? */
     if (parser.isSet(certificatesOption)) {
-        QString path = parser.value(certificatesOption);
-        QList<QSslCertificate> certs = QSslCertificate::fromPath(path, QSsl::Pem, QRegExp::Wildcard);
+        QString glob = parser.value(certificatesOption);
+        QList<QSslCertificate> certs;
+
+        err = loadCertificates(glob, certs);
+        if (!err.isNull()) {
+            fprintf(stderr, "Couldn't load certificates %s: %s\n", qPrintable(glob), qPrintable(err));
+            return -1;
+        }
 
         QSslConfiguration config = QSslConfiguration::defaultConfiguration();
         config.setCaCertificates(certs);
@@ -109,8 +228,51 @@ int main(int argc, char * argv[]) {
         network->setSslConfig(config);
     }
 
+    /* Set up shared memory for large messages, before anything else gets
+     * written to stdout. */
+    if (parser.isSet(shmOption)) {
+        /* Messages are copied in and out of QByteArrays, which can't hold
+         * 2GB or more. */
+        qint64 size = qint64(parser.value(shmOption).toInt()) * 1024 * 1024;
+        if (size <= 0 || size > INT_MAX) {
+            fprintf(stderr, "Invalid shared memory size: %s\n", qPrintable(parser.value(shmOption)));
+            return -1;
+        }
+
+        err = stdio->enableSharedMemory(size, parser.value(shmThresholdOption).toInt());
+        if (!err.isNull()) {
+            fprintf(stderr, "Couldn't set up shared memory: %s\n", qPrintable(err));
+            return -1;
+        }
+    }
+
+    /* Pick up TLS sessions from earlier runs. */
+    if (parser.isSet(tlsSessionsOption)) {
+        err = network->tlsSessions()->load(parser.value(tlsSessionsOption));
+        if (!err.isNull())
+            fprintf(stderr, "Couldn't load TLS sessions %s: %s\n", qPrintable(parser.value(tlsSessionsOption)), qPrintable(err));
+    }
+
     /* Finally, launch the sandbox environment. */
-    sandbox->launch(path, QString::fromUtf8(buf), args);
+    sandbox->launch(path, src, args);
+
+    int code = app.exec();
+
+    Tracer::close();
+
+    /* Save TLS sessions for the next run. */
+    if (parser.isSet(tlsSessionsOption)) {
+        err = network->tlsSessions()->save(parser.value(tlsSessionsOption));
+        if (!err.isNull())
+            fprintf(stderr, "Couldn't save TLS sessions %s: %s\n", qPrintable(parser.value(tlsSessionsOption)), qPrintable(err));
+    }
+
+    /* Pack up everything we've loaded, if asked to. */
+    if (parser.isSet(writeBundleOption)) {
+        err = scripts->writeBundle(parser.value(writeBundleOption));
+        if (!err.isNull())
+            fprintf(stderr, "Couldn't write bundle %s: %s\n", qPrintable(parser.value(writeBundleOption)), qPrintable(err));
+    }
 
-    return app.exec();
+    return code;
 }
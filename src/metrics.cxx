@@ -0,0 +1,381 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef Q_OS_MAC
+#include <mach/mach.h>
+#endif
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+
+#include "./metrics.h"
+
+
+static Gauge residentMemory("koala_resident_memory_bytes", "Resident set size of the process.");
+static Gauge peakResidentMemory("koala_peak_resident_memory_bytes", "Peak resident set size of the process.");
+static Histogram eventLoopLag("koala_event_loop_lag_seconds", "Delay between when timers were due and when they fired.");
+
+
+/* Interval at which we measure event loop lag, in milliseconds. */
+static const int lagInterval = 100;
+
+/* Pipe used to get from our signal handler back into the event loop. */
+static int signalPipe[2] = { -1, -1 };
+
+
+/* Find the bucket a value belongs in. */
+static int bucketIndex(qint64 value) {
+    const int sub = 1 << Histogram::subBits;
+
+    if (value < sub)
+        return value < 0 ? 0 : int(value);
+
+    int exp = 63 - __builtin_clzll((unsigned long long) value);
+    int index = ((exp - Histogram::subBits + 1) << Histogram::subBits) +
+                (int(value >> (exp - Histogram::subBits)) & (sub - 1));
+
+    return qMin(index, Histogram::bucketCount - 1);
+}
+
+
+/* Return the value in the middle of a bucket. */
+static qint64 bucketMidpoint(int index) {
+    const int sub = 1 << Histogram::subBits;
+
+    if (index < sub)
+        return index;
+
+    int shift = (index >> Histogram::subBits) - 1;
+    qint64 low = qint64(sub + (index & (sub - 1))) << shift;
+
+    return low + ((qint64(1) << shift) >> 1);
+}
+
+
+/* Format a microsecond value as seconds. */
+static QByteArray seconds(qint64 micros) {
+    return QByteArray::number(micros / 1e6, 'g', 9);
+}
+
+
+/* Update metrics sampled from the operating system. */
+static void sampleResources() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MAC
+        peakResidentMemory.set(usage.ru_maxrss);
+#else
+        peakResidentMemory.set(qint64(usage.ru_maxrss) * 1024);
+#endif
+    }
+
+#ifdef Q_OS_MAC
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS)
+        residentMemory.set(info.resident_size);
+#else
+    QFile statm("/proc/self/statm");
+    if (statm.open(QFile::ReadOnly)) {
+        QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1)
+            residentMemory.set(fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE));
+    }
+#endif
+}
+
+
+/* Write the HELP and TYPE lines of a metric. */
+static void exposeHeader(QByteArray & out, const Metric * metric, const char * type) {
+    out += "# HELP ";
+    out += metric->name;
+    out += ' ';
+    out += metric->help;
+    out += "\n# TYPE ";
+    out += metric->name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+
+Metric::Metric(const char * name, const char * help)
+    : name(name)
+    , help(help) {
+    Metrics::all().append(this);
+}
+
+
+void Counter::snapshot(QVariantMap & out) const {
+    out[this->name] = this->get();
+}
+
+
+void Counter::expose(QByteArray & out) const {
+    exposeHeader(out, this, "counter");
+    out += this->name;
+    out += ' ';
+    out += QByteArray::number(this->get());
+    out += '\n';
+}
+
+
+void Gauge::snapshot(QVariantMap & out) const {
+    out[this->name] = this->get();
+}
+
+
+void Gauge::expose(QByteArray & out) const {
+    exposeHeader(out, this, "gauge");
+    out += this->name;
+    out += ' ';
+    out += QByteArray::number(this->get());
+    out += '\n';
+}
+
+
+Histogram::Histogram(const char * name, const char * help)
+    : Metric(name, help)
+    , count(0)
+    , sum(0)
+    , max(0) {
+}
+
+
+void Histogram::record(qint64 micros) {
+    if (micros < 0)
+        micros = 0;
+
+    this->buckets[bucketIndex(micros)].fetchAndAddRelaxed(1);
+    this->count.fetchAndAddRelaxed(1);
+    this->sum.fetchAndAddRelaxed(micros);
+
+    qint64 cur = this->max.load();
+    while (micros > cur && !this->max.testAndSetRelaxed(cur, micros))
+        cur = this->max.load();
+}
+
+
+qint64 Histogram::quantile(double q) const {
+    qint64 total = this->count.load();
+    if (total == 0)
+        return 0;
+
+    qint64 rank = qMax(qint64(1), qint64(q * total + 0.5));
+    qint64 seen = 0;
+
+    for (int i = 0; i < bucketCount; i++) {
+        seen += this->buckets[i].load();
+        if (seen >= rank)
+            return qMin(bucketMidpoint(i), this->max.load());
+    }
+
+    return this->max.load();
+}
+
+
+void Histogram::snapshot(QVariantMap & out) const {
+    QVariantMap raw;
+
+    raw["count"] = this->count.load();
+    raw["sum"] = this->sum.load() / 1e6;
+    raw["max"] = this->max.load() / 1e6;
+    raw["p50"] = this->quantile(0.5) / 1e6;
+    raw["p90"] = this->quantile(0.9) / 1e6;
+    raw["p99"] = this->quantile(0.99) / 1e6;
+
+    out[this->name] = raw;
+}
+
+
+void Histogram::expose(QByteArray & out) const {
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+
+    exposeHeader(out, this, "summary");
+
+    for (int i = 0; i < 3; i++) {
+        out += this->name;
+        out += "{quantile=\"";
+        out += QByteArray::number(quantiles[i]);
+        out += "\"} ";
+        out += seconds(this->quantile(quantiles[i]));
+        out += '\n';
+    }
+
+    out += this->name;
+    out += "_sum ";
+    out += seconds(this->sum.load());
+    out += '\n';
+
+    out += this->name;
+    out += "_count ";
+    out += QByteArray::number(this->count.load());
+    out += '\n';
+}
+
+
+QList<Metric *> & Metrics::all() {
+    /* Metrics register themselves during static initialization, so the
+     * registry has to be constructed on first use. */
+    static QList<Metric *> metrics;
+    return metrics;
+}
+
+
+qint64 Metrics::now() {
+    static struct Clock {
+        QElapsedTimer timer;
+        Clock() { this->timer.start(); }
+    } clock;
+
+    return clock.timer.nsecsElapsed() / 1000;
+}
+
+
+QVariantMap Metrics::snapshot() {
+    QVariantMap out;
+
+    sampleResources();
+
+    foreach (Metric * metric, all())
+        metric->snapshot(out);
+
+    return out;
+}
+
+
+QByteArray Metrics::expose() {
+    QByteArray out;
+
+    sampleResources();
+
+    foreach (Metric * metric, all())
+        metric->expose(out);
+
+    return out;
+}
+
+
+/* Signal handler for SIGUSR1. Preserves `errno`, as `write` may clobber it
+ * underneath whatever code the signal interrupted. */
+static void onSigusr1(int) {
+    int saved = errno;
+
+    char c = 0;
+    if (write(signalPipe[1], &c, 1) < 0) {
+        /* Nothing we can do about it. */
+    }
+
+    errno = saved;
+}
+
+
+MetricsReporter::MetricsReporter(QObject * parent)
+    : QObject(parent)
+    , lagTimer(new QTimer(this))
+    , lastTick(0)
+    , signalNotifier(NULL)
+    , fileTimer(NULL) {
+    /* Start measuring event loop lag. */
+    this->lagTimer->setTimerType(Qt::PreciseTimer);
+    this->lagTimer->setInterval(lagInterval);
+
+    QObject::connect(this->lagTimer, SIGNAL(timeout()),
+                     this, SLOT(onLagTick()));
+
+    this->lastTick = Metrics::now();
+    this->lagTimer->start();
+
+    /* Dump all metrics on SIGUSR1. The signal handler itself only writes to
+     * a pipe, and the actual work is done from the event loop. */
+    if (pipe(signalPipe) == 0) {
+        /* Neither end may ever block: a burst of signals filling up the pipe
+         * would otherwise stall the signal handler, and with it the thread
+         * it interrupted. */
+        for (int i = 0; i < 2; i++) {
+            fcntl(signalPipe[i], F_SETFL, fcntl(signalPipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(signalPipe[i], F_SETFD, FD_CLOEXEC);
+        }
+
+        this->signalNotifier = new QSocketNotifier(signalPipe[0], QSocketNotifier::Read, this);
+        QObject::connect(this->signalNotifier, SIGNAL(activated(int)),
+                         this, SLOT(onSignal()));
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onSigusr1;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, NULL);
+    }
+}
+
+
+void MetricsReporter::writeTo(const QString path, int intervalMs) {
+    this->path = path;
+
+    if (this->fileTimer == NULL) {
+        this->fileTimer = new QTimer(this);
+        QObject::connect(this->fileTimer, SIGNAL(timeout()),
+                         this, SLOT(onWriteFile()));
+    }
+
+    this->fileTimer->start(intervalMs);
+    this->onWriteFile();
+}
+
+
+void MetricsReporter::onLagTick() {
+    qint64 now = Metrics::now();
+    eventLoopLag.record(now - this->lastTick - lagInterval * 1000);
+    this->lastTick = now;
+}
+
+
+void MetricsReporter::onSignal() {
+    /* Drain the pipe; any number of signals received since the last time
+     * results in a single dump. */
+    char buf[64];
+    int reads = 0;
+
+    while (read(signalPipe[0], buf, sizeof(buf)) > 0)
+        reads++;
+
+    if (reads == 0)
+        return;
+
+    QByteArray out = Metrics::expose();
+    fwrite(out.constData(), 1, out.size(), stderr);
+    fflush(stderr);
+}
+
+
+void MetricsReporter::onWriteFile() {
+    QSaveFile file(this->path);
+    if (!file.open(QFile::WriteOnly))
+        return;
+
+    file.write(Metrics::expose());
+    file.commit();
+}
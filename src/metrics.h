@@ -0,0 +1,178 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QVariant>
+
+
+/* The Metric class is the base of all runtime metrics. Metrics are meant to
+ * be defined as static variables next to the code which updates them, and
+ * register themselves with the global registry on construction. Updating a
+ * metric is a single atomic operation, so it can be done from any thread. */
+class Metric {
+public:
+    /* Name and description, as exposed in the Prometheus text format. */
+    const char * name;
+    const char * help;
+
+    Metric(const char * name, const char * help);
+    virtual ~Metric() { }
+
+    /* Add the metric's current value to a `koala.stats()` snapshot. */
+    virtual void snapshot(QVariantMap & out) const = 0;
+
+    /* Append the metric in Prometheus text format. */
+    virtual void expose(QByteArray & out) const = 0;
+};
+
+
+/* A monotonically increasing count. */
+class Counter : public Metric {
+private:
+    QAtomicInteger<qint64> value;
+
+public:
+    Counter(const char * name, const char * help)
+        : Metric(name, help)
+        , value(0) {
+    }
+
+    void add(qint64 n = 1) {
+        this->value.fetchAndAddRelaxed(n);
+    }
+
+    qint64 get() const {
+        return this->value.load();
+    }
+
+    void snapshot(QVariantMap & out) const;
+    void expose(QByteArray & out) const;
+};
+
+
+/* A value which can go up and down. */
+class Gauge : public Metric {
+private:
+    QAtomicInteger<qint64> value;
+
+public:
+    Gauge(const char * name, const char * help)
+        : Metric(name, help)
+        , value(0) {
+    }
+
+    void set(qint64 n) {
+        this->value.store(n);
+    }
+
+    void add(qint64 n) {
+        this->value.fetchAndAddRelaxed(n);
+    }
+
+    qint64 get() const {
+        return this->value.load();
+    }
+
+    void snapshot(QVariantMap & out) const;
+    void expose(QByteArray & out) const;
+};
+
+
+/* A distribution of durations, recorded in microseconds and exposed in
+ * seconds. Values are counted in log-linear buckets (16 per power of two,
+ * in the style of HDR histograms), which keeps the relative error of
+ * reported quantiles within about 6%. */
+class Histogram : public Metric {
+public:
+    /* Number of linear sub-buckets per power of two, as a power of two. */
+    static const int subBits = 4;
+
+    /* Total number of buckets, which covers values up to 2^40us. */
+    static const int bucketCount = (40 - subBits + 2) << subBits;
+
+private:
+    QAtomicInteger<qint64> buckets[bucketCount];
+    QAtomicInteger<qint64> count;
+    QAtomicInteger<qint64> sum;
+    QAtomicInteger<qint64> max;
+
+public:
+    Histogram(const char * name, const char * help);
+
+    /* Record a duration, in microseconds. */
+    void record(qint64 micros);
+
+    /* Estimate a quantile (between 0 and 1), in microseconds. */
+    qint64 quantile(double q) const;
+
+    void snapshot(QVariantMap & out) const;
+    void expose(QByteArray & out) const;
+};
+
+
+/* Global metrics registry. */
+class Metrics {
+public:
+    /* All registered metrics. */
+    static QList<Metric *> & all();
+
+    /* Monotonic clock, in microseconds, for measuring durations. */
+    static qint64 now();
+
+    /* Snapshot of all metrics, keyed by name. */
+    static QVariantMap snapshot();
+
+    /* All metrics in Prometheus text format. */
+    static QByteArray expose();
+};
+
+
+/* The MetricsReporter class takes care of everything that needs to happen
+ * periodically or asynchronously: measuring event loop lag, dumping all
+ * metrics to stderr on SIGUSR1, and writing them to a file for scraping. */
+class MetricsReporter : public QObject {
+    Q_OBJECT
+
+private:
+    /* Timer used to measure event loop lag. */
+    QTimer * lagTimer;
+    qint64 lastTick;
+
+    /* Read end of the pipe our signal handler writes to. */
+    QSocketNotifier * signalNotifier;
+
+    /* File to periodically write metrics to. */
+    QString path;
+    QTimer * fileTimer;
+
+public:
+    /* Construct a new MetricsReporter and start measuring. */
+    MetricsReporter(QObject * parent = NULL);
+
+    /* Periodically write all metrics to `path`, in Prometheus text format.
+     * The file is replaced atomically, so readers never see partial output. */
+    void writeTo(const QString path, int intervalMs);
+
+private slots:
+    void onLagTick();
+    void onSignal();
+    void onWriteFile();
+};
@@ -12,17 +12,135 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QNetworkCookie>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 
+#include "./metrics.h"
 #include "./network.h"
+#include "./trace.h"
+
+
+static Counter requestsTotal("koala_network_requests_total", "Network requests made.");
+static Counter requestsBlocked("koala_network_requests_blocked_total", "Network requests blocked due to their URL scheme.");
+static Counter bytesReceived("koala_network_received_bytes_total", "Bytes of response data received.");
+static Counter requestsWarm("koala_network_requests_warm_total", "Network requests made to an origin with a preconnected connection.");
+static Counter preconnectsTotal("koala_network_preconnects_total", "Connections opened ahead of time with `koala.preconnect`.");
+static Histogram requestDuration("koala_network_request_duration_seconds", "Time from creating a request until its reply finished.");
+
+
+/* How long a preconnected connection is assumed to stay open without being
+ * used. Servers usually close idle connections after somewhere between 5
+ * seconds and a couple of minutes. */
+static const qint64 warmWindow = 30000;
+
+
+/* Return the "scheme://host:port" origin of a URL. */
+static QString originOf(const QUrl & url) {
+    QString scheme = url.scheme().toLower();
+    int port = url.port(scheme == "https" ? 443 : 80);
+
+    return scheme + "://" + url.host().toLower() + ":" + QString::number(port);
+}
+
+
+NetworkManager::NetworkManager(QObject * parent)
+                             : QNetworkAccessManager(parent)
+                             , sawFirstQRCRequest(false)
+                             , sessions(new TlsSessionCache(this))
+                             , proxyPool(new ProxyPool)
+                             , thread(new QThread(this))
+                             , transport(new NetworkTransport(this->sessions)) {
+    qRegisterMetaType<TransportMeta>("TransportMeta");
+    qRegisterMetaType<QSslConfiguration>("QSslConfiguration");
+    qRegisterMetaType<QList<QSslError> >("QList<QSslError>");
+
+    this->setSslConfig(QSslConfiguration::defaultConfiguration());
+
+    /* Set up the transport before moving it over to the network thread;
+     * from then on it may only be talked to through queued calls. */
+    this->transport->setProxyFactory(this->proxyPool);
+    this->transport->moveToThread(this->thread);
+
+    QObject::connect(this->thread, SIGNAL(finished()),
+                     this->transport, SLOT(deleteLater()));
+
+    this->thread->start();
+}
+
+
+NetworkManager::~NetworkManager() {
+    this->thread->quit();
+    this->thread->wait();
+}
 
 
 void NetworkManager::setSslConfig(QSslConfiguration config) {
+    /* Qt won't hand out session tickets unless session persistence has
+     * been enabled. */
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
     this->sslConfig = config;
 }
 
 
+TlsSessionCache * NetworkManager::tlsSessions() const {
+    return this->sessions;
+}
+
+
+ProxyPool * NetworkManager::proxies() const {
+    return this->proxyPool;
+}
+
+
+void NetworkManager::preconnect(const QUrl & url) {
+    QString scheme = url.scheme().toLower();
+    if ((scheme != "http" && scheme != "https") || url.host().isEmpty())
+        return;
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QString origin = originOf(url);
+
+    /* Don't bother if we've recently warmed this origin already. */
+    if (now - this->warmed.value(origin, 0) < warmWindow)
+        return;
+
+    /* Forget origins which were warmed up but never used. */
+    if (this->warmed.size() >= 1024) {
+        QHash<QString, qint64>::iterator it = this->warmed.begin();
+
+        while (it != this->warmed.end()) {
+            if (now - it.value() >= warmWindow)
+                it = this->warmed.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    this->warmed.insert(origin, now);
+
+    /* Start resolving the host straight away. Qt doesn't accept resolved
+     * addresses, but QHostInfo keeps a process-wide cache of its own, which
+     * the transport's connection will then pick the result up from. */
+    QHostInfo::lookupHost(url.host(), this, SLOT(onHostLookedUp(QHostInfo)));
+
+    QSslConfiguration config = this->sslConfig;
+    if (scheme == "https")
+        this->sessions->apply(url, config);
+
+    QMetaObject::invokeMethod(this->transport, "preconnect", Qt::QueuedConnection,
+                              Q_ARG(QString, url.host()),
+                              Q_ARG(int, url.port(scheme == "https" ? 443 : 80)),
+                              Q_ARG(bool, scheme == "https"),
+                              Q_ARG(QSslConfiguration, config));
+
+    preconnectsTotal.add();
+    Tracer::instant("network", "preconnect", origin);
+}
+
+
 QNetworkReply * NetworkManager::createRequest(QNetworkAccessManager::Operation op,
                                               const QNetworkRequest & request,
                                               QIODevice * data) {
@@ -35,15 +153,194 @@ QNetworkReply * NetworkManager::createRequest(QNetworkAccessManager::Operation o
         if (this->sawFirstQRCRequest == false)
             this->sawFirstQRCRequest = true;
         else
-            return new BlockedReply(op, req);
+            return this->block(op, req);
     } else if (scheme == "file") {
-        return new BlockedReply(op, req);
+        return this->block(op, req);
     }
 
-    /* Attach our SSL configuration to the request. */
-    req.setSslConfiguration(this->sslConfig);
+    /* Attach our SSL configuration to the request, along with a session
+     * ticket from an earlier connection to the same host, if we have one. */
+    QSslConfiguration config = this->sslConfig;
+    if (scheme == "https")
+        this->sessions->apply(req.url(), config);
+
+    req.setSslConfiguration(config);
+
+    /* Count requests which should be able to pick up a connection opened
+     * with `preconnect`. This is an estimate, as Qt doesn't tell us whether
+     * a request re-used an existing connection. */
+    if (!this->warmed.isEmpty()) {
+        QString origin = originOf(req.url());
+        qint64 at = this->warmed.take(origin);
+
+        if (at > 0 && QDateTime::currentMSecsSinceEpoch() - at < warmWindow)
+            requestsWarm.add();
+    }
+
+    /* Settle on a proxy for the request's host, and send the request through
+     * that very proxy. */
+    QString proxy;
+    QNetworkReply * reply;
+
+    if (scheme == "http" || scheme == "https") {
+        proxy = this->proxyPool->begin(req.url().host());
+        reply = this->dispatch(op, req, data, proxy);
+    } else {
+        reply = QNetworkAccessManager::createRequest(op, req, data);
+    }
+
+    requestsTotal.add();
+    reply->setProperty("koalaStarted", Metrics::now());
+    reply->setProperty("koalaProxy", proxy);
+
+    QObject::connect(reply, SIGNAL(downloadProgress(qint64, qint64)),
+                     this, SLOT(onReplyDownloadProgress(qint64, qint64)));
+    QObject::connect(reply, SIGNAL(finished()),
+                     this, SLOT(onReplyFinished()));
+
+    Tracer::begin("network", "request", (quintptr) reply, req.url().toString());
+
+    /* Synchronous requests are already finished at this point, before we
+     * had a chance to connect to their `finished` signal. */
+    if (reply->isFinished())
+        this->finish(reply);
+
+    return reply;
+}
+
+
+QNetworkReply * NetworkManager::block(QNetworkAccessManager::Operation op,
+                                      const QNetworkRequest & req) {
+    requestsBlocked.add();
+    Tracer::instant("network", "blocked", req.url().toString());
+    return new BlockedReply(op, req);
+}
+
+
+QNetworkReply * NetworkManager::dispatch(QNetworkAccessManager::Operation op,
+                                         const QNetworkRequest & req,
+                                         QIODevice * data,
+                                         const QString & proxy) {
+    QNetworkRequest forwarded(req);
+    QNetworkCookieJar * jar = this->cookieJar();
+
+    /* The cookie jar lives on this thread, so cookies are attached here
+     * (and stored again by the reply), rather than by the transport. */
+    int load = req.attribute(QNetworkRequest::CookieLoadControlAttribute,
+                             QNetworkRequest::Automatic).toInt();
+
+    if (load == QNetworkRequest::Automatic && !req.hasRawHeader("Cookie")) {
+        QList<QNetworkCookie> cookies = jar->cookiesForUrl(req.url());
+        if (!cookies.isEmpty())
+            forwarded.setHeader(QNetworkRequest::CookieHeader, QVariant::fromValue(cookies));
+    }
+
+    forwarded.setAttribute(QNetworkRequest::CookieLoadControlAttribute, QNetworkRequest::Manual);
+    forwarded.setAttribute(QNetworkRequest::CookieSaveControlAttribute, QNetworkRequest::Manual);
+
+    QByteArray body;
+    if (data != NULL)
+        body = data->readAll();
+
+    ThreadedReply * reply = new ThreadedReply(op, req, jar, this);
+    TransportJob * job = new TransportJob(op, forwarded, body, proxy);
+
+    QObject::connect(job, SIGNAL(metaDataReady(TransportMeta)),
+                     reply, SLOT(onMetaDataReady(TransportMeta)));
+    QObject::connect(job, SIGNAL(dataReady(QByteArray)),
+                     reply, SLOT(onDataReady(QByteArray)));
+    QObject::connect(job, SIGNAL(downloadProgress(qint64, qint64)),
+                     reply, SIGNAL(downloadProgress(qint64, qint64)));
+    QObject::connect(job, SIGNAL(uploadProgress(qint64, qint64)),
+                     reply, SIGNAL(uploadProgress(qint64, qint64)));
+    QObject::connect(job, SIGNAL(sslErrors(QList<QSslError>)),
+                     reply, SLOT(onSslErrors(QList<QSslError>)));
+    QObject::connect(job, SIGNAL(done(int, QString)),
+                     reply, SLOT(onDone(int, QString)));
+    QObject::connect(reply, SIGNAL(sslErrors(QList<QSslError>)),
+                     this, SLOT(onReplySslErrors(QList<QSslError>)));
+
+    /* Stop the request if the reply is aborted or thrown away early. */
+    QObject::connect(reply, SIGNAL(abortRequested()),
+                     job, SLOT(cancel()));
+    QObject::connect(reply, SIGNAL(destroyed()),
+                     job, SLOT(cancel()));
+
+    job->moveToThread(this->thread);
+
+    /* Synchronous requests (made by synchronous XMLHttpRequests) have to be
+     * finished by the time we return, so run them on the network thread as
+     * usual, but wait for them there, and then deliver everything the job
+     * has sent us right away. */
+    if (req.attribute(QNetworkRequest::SynchronousRequestAttribute, false).toBool()) {
+        QMetaObject::invokeMethod(this->transport, "start", Qt::BlockingQueuedConnection,
+                                  Q_ARG(QObject *, job));
+        QCoreApplication::sendPostedEvents(reply, QEvent::MetaCall);
+    } else {
+        QMetaObject::invokeMethod(this->transport, "start", Qt::QueuedConnection,
+                                  Q_ARG(QObject *, job));
+    }
+
+    return reply;
+}
+
+
+void NetworkManager::onReplyDownloadProgress(qint64 received, qint64 total) {
+    Q_UNUSED(total);
+
+    /* Progress is reported as a running total, so keep track of how much
+     * we've already counted. */
+    QObject * reply = this->sender();
+    qint64 counted = reply->property("koalaReceived").toLongLong();
+
+    if (received > counted) {
+        bytesReceived.add(received - counted);
+        reply->setProperty("koalaReceived", received);
+    }
+}
+
+
+void NetworkManager::onReplySslErrors(const QList<QSslError> & errors) {
+    emit this->sslErrors((QNetworkReply *) this->sender(), errors);
+}
+
+
+void NetworkManager::onReplyFinished() {
+    this->finish((QNetworkReply *) this->sender());
+}
+
+
+void NetworkManager::finish(QNetworkReply * reply) {
+    qint64 duration = Metrics::now() - reply->property("koalaStarted").toLongLong();
+
+    requestDuration.record(duration);
+
+    /* Let the proxy pool know how its proxy did. Only errors reported as the
+     * proxy's own count against it; through a SOCKS proxy, a target server
+     * refusing the connection, timing out or not resolving looks no
+     * different from the proxy itself doing so, and shouldn't get a healthy
+     * proxy ejected. */
+    QString proxy = reply->property("koalaProxy").toString();
+
+    if (!proxy.isEmpty()) {
+        QNetworkReply::NetworkError error = reply->error();
+        ProxyPool::Outcome outcome = ProxyPool::Succeeded;
+
+        if (error == QNetworkReply::OperationCanceledError)
+            outcome = ProxyPool::Cancelled;
+        else if (error >= QNetworkReply::ProxyConnectionRefusedError &&
+                 error <= QNetworkReply::UnknownProxyError)
+            outcome = ProxyPool::Failed;
+
+        this->proxyPool->end(proxy, duration / 1000, outcome);
+    }
+
+    Tracer::end("network", "request", (quintptr) reply, reply->url().toString());
+}
+
 
-    return QNetworkAccessManager::createRequest(op, req, data);
+void NetworkManager::onHostLookedUp(const QHostInfo & info) {
+    Tracer::instant("network", "resolved", info.hostName());
 }
 
 
@@ -14,10 +14,15 @@
 
 #pragma once
 
+#include <QHostInfo>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QThread>
 
+#include "./proxy.h"
 #include "./sandbox.h"
+#include "./tls.h"
+#include "./transport.h"
 
 
 /* The NetworkManager class implements our custom logic for dealing with
@@ -33,26 +38,79 @@ private:
     /* SSL configuration. */
     QSslConfiguration sslConfig;
 
+    /* TLS session tickets, shared by all requests. */
+    TlsSessionCache * sessions;
+
+    /* Upstream proxies. Owned by the transport, as its proxy factory. */
+    ProxyPool * proxyPool;
+
+    /* HTTP and HTTPS requests are carried out by the transport, on a
+     * network thread of its own. */
+    QThread * thread;
+    NetworkTransport * transport;
+
+    /* Origins ("scheme://host:port") we've opened connections to ahead of
+     * time, and when we did so. An origin is removed again as soon as a
+     * request has been made to it. */
+    QHash<QString, qint64> warmed;
+
 public:
     /* Constructs a new NetworkManager instance. */
-    NetworkManager(QObject * parent = NULL)
-                 : QNetworkAccessManager(parent)
-                 , sawFirstQRCRequest(false)
-                 , sslConfig(QSslConfiguration::defaultConfiguration()) {
-    }
+    NetworkManager(QObject * parent = NULL);
+
+    /* Stops the network thread. */
+    ~NetworkManager();
 
     /* Overwrite the network manager's SSL settings. */
     void setSslConfig(QSslConfiguration config);
 
+    /* Return the TLS session cache. */
+    TlsSessionCache * tlsSessions() const;
+
+    /* Return the pool of upstream proxies. */
+    ProxyPool * proxies() const;
+
+    /* Resolve a URL's host name and open a connection to it (including the
+     * TLS handshake, for HTTPS), so that it's ready by the time the first
+     * request for it is made. */
+    void preconnect(const QUrl & url);
+
 protected:
     /* Creates a QNetworkReply in response to the request. */
     QNetworkReply * createRequest(QNetworkAccessManager::Operation op,
                                   const QNetworkRequest & req,
                                   QIODevice * data = NULL);
 
+private:
+    /* Create a reply for a request we refuse to let through. */
+    QNetworkReply * block(QNetworkAccessManager::Operation op,
+                          const QNetworkRequest & req);
+
+    /* Hand a request over to the network thread, returning a reply which
+     * receives its response on this thread. The request is sent through the
+     * named pooled proxy, if any. */
+    QNetworkReply * dispatch(QNetworkAccessManager::Operation op,
+                             const QNetworkRequest & req,
+                             QIODevice * data,
+                             const QString & proxy);
+
+    /* Update metrics, trace events and proxy health for a finished reply. */
+    void finish(QNetworkReply * reply);
+
 signals:
     /* Signal emitted when a request is blocked due to its URL scheme. */
     void requestBlocked(QObject * origin, QUrl url);
+
+private slots:
+    /* Handlers for signals emitted by replies created by `createRequest`,
+     * used to keep metrics and trace events up to date, and to pass SSL
+     * errors on through our own `sslErrors` signal. */
+    void onReplyDownloadProgress(qint64 received, qint64 total);
+    void onReplySslErrors(const QList<QSslError> & errors);
+
+    /* Receives the results of host lookups started by `preconnect`. */
+    void onHostLookedUp(const QHostInfo & info);
+    void onReplyFinished();
 };
 
 
@@ -0,0 +1,273 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QUrl>
+
+#include "./metrics.h"
+#include "./proxy.h"
+
+
+static Counter ejectionsTotal("koala_proxy_ejections_total", "Times a proxy was ejected from the pool after repeated failures.");
+
+
+/* Number of failures in a row after which a proxy is ejected. */
+static const int ejectAfter = 3;
+
+/* How long a proxy is ejected for the first time, and at most. */
+static const qint64 minEjection = 30 * 1000;
+static const qint64 maxEjection = 10 * 60 * 1000;
+
+/* Maximum number of sticky host assignments to remember. */
+static const int maxAssignments = 65536;
+
+
+QString ProxyPool::setProxies(const QStringList & specs) {
+    QStringList names;
+    QList<QNetworkProxy> proxies;
+
+    foreach (QString spec, specs) {
+        spec = spec.trimmed();
+        if (spec.isEmpty())
+            continue;
+
+        QUrl url = QUrl::fromUserInput(spec.contains("://") ? spec : "http://" + spec);
+        QString scheme = url.scheme().toLower();
+
+        if (!url.isValid() || url.host().isEmpty() || (scheme != "http" && scheme != "socks5"))
+            return QString("invalid proxy: %1").arg(spec);
+
+        QNetworkProxy proxy(scheme == "socks5" ? QNetworkProxy::Socks5Proxy : QNetworkProxy::HttpProxy,
+                            url.host(), quint16(url.port(scheme == "socks5" ? 1080 : 8080)),
+                            url.userName(), url.password());
+
+        QString name = url.host() + ":" + QString::number(proxy.port());
+        if (names.contains(name))
+            continue;
+
+        names += name;
+        proxies += proxy;
+    }
+
+    QMutexLocker lock(&this->mutex);
+
+    /* Proxies staying in the pool keep their state, as requests already in
+     * flight through them will still report back. Requests through proxies
+     * no longer in the pool are simply ignored when they do. */
+    QHash<QString, Upstream> upstreams;
+
+    for (int i = 0; i < names.size(); i++) {
+        QHash<QString, Upstream>::const_iterator it = this->upstreams.constFind(names.at(i));
+        Upstream upstream;
+
+        if (it != this->upstreams.constEnd()) {
+            upstream = *it;
+        } else {
+            upstream.outstanding = 0;
+            upstream.requests = 0;
+            upstream.errors = 0;
+            upstream.consecutiveErrors = 0;
+            upstream.latency = 0.0;
+            upstream.ejectedUntil = 0;
+            upstream.ejections = 0;
+        }
+
+        upstream.proxy = proxies.at(i);
+        upstreams.insert(names.at(i), upstream);
+    }
+
+    /* Hosts stick with their proxy, if it's still around. */
+    QHash<QString, QString>::iterator it = this->assignments.begin();
+    while (it != this->assignments.end()) {
+        if (upstreams.contains(it.value()))
+            ++it;
+        else
+            it = this->assignments.erase(it);
+    }
+
+    this->names = names;
+    this->upstreams = upstreams;
+    this->cursor = 0;
+
+    return QString();
+}
+
+
+void ProxyPool::setStrategy(Strategy strategy) {
+    QMutexLocker lock(&this->mutex);
+    this->strategy = strategy;
+}
+
+
+QList<QNetworkProxy> ProxyPool::queryProxy(const QNetworkProxyQuery & query) {
+    QMutexLocker lock(&this->mutex);
+
+    if (this->names.isEmpty()) {
+        lock.unlock();
+        return QNetworkProxyFactory::proxyForQuery(query);
+    }
+
+    QString name = this->assign(query.peerHostName().toLower(), QDateTime::currentMSecsSinceEpoch());
+    return QList<QNetworkProxy>() << this->upstreams.value(name).proxy;
+}
+
+
+bool ProxyPool::lookup(const QString & name, QNetworkProxy & proxy) const {
+    QMutexLocker lock(&this->mutex);
+
+    QHash<QString, Upstream>::const_iterator it = this->upstreams.constFind(name);
+    if (it == this->upstreams.constEnd())
+        return false;
+
+    proxy = it->proxy;
+    return true;
+}
+
+
+QString ProxyPool::begin(const QString & host) {
+    QMutexLocker lock(&this->mutex);
+
+    if (this->names.isEmpty())
+        return QString();
+
+    QString name = this->assign(host.toLower(), QDateTime::currentMSecsSinceEpoch());
+
+    Upstream & upstream = this->upstreams[name];
+    upstream.outstanding++;
+    upstream.requests++;
+
+    return name;
+}
+
+
+void ProxyPool::end(const QString & name, qint64 latency, Outcome outcome) {
+    QMutexLocker lock(&this->mutex);
+
+    QHash<QString, Upstream>::iterator it = this->upstreams.find(name);
+    if (it == this->upstreams.end())
+        return;
+
+    /* A proxy dropped from the pool and added back again starts over, so
+     * requests started before that mustn't push it below zero. */
+    if (it->outstanding > 0)
+        it->outstanding--;
+
+    if (outcome == Succeeded) {
+        it->latency = it->latency == 0.0 ? latency : 0.8 * it->latency + 0.2 * latency;
+        it->consecutiveErrors = 0;
+        it->ejections = 0;
+    } else if (outcome == Failed) {
+        it->errors++;
+
+        /* Eject the proxy once it has failed too many times in a row. Its
+         * hosts will be reassigned the next time they're requested. */
+        if (++it->consecutiveErrors >= ejectAfter) {
+            qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+            it->ejectedUntil = now + qMin(maxEjection, minEjection << qMin(it->ejections, 8));
+            it->ejections++;
+            it->consecutiveErrors = 0;
+
+            ejectionsTotal.add();
+        }
+    }
+}
+
+
+QVariantList ProxyPool::stats() const {
+    QMutexLocker lock(&this->mutex);
+
+    QVariantList out;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    foreach (QString name, this->names) {
+        const Upstream & upstream = this->upstreams[name];
+        QVariantMap raw;
+
+        raw["proxy"] = name;
+        raw["healthy"] = upstream.ejectedUntil <= now;
+        raw["outstanding"] = upstream.outstanding;
+        raw["requests"] = upstream.requests;
+        raw["errors"] = upstream.errors;
+        raw["latency"] = upstream.latency;
+
+        out += raw;
+    }
+
+    return out;
+}
+
+
+bool ProxyPool::parseStrategy(const QString name, Strategy & strategy) {
+    if (name == "round-robin")
+        strategy = RoundRobin;
+    else if (name == "least-outstanding")
+        strategy = LeastOutstanding;
+    else
+        return false;
+
+    return true;
+}
+
+
+QString ProxyPool::assign(const QString & host, qint64 now) {
+    /* Stick with the current assignment, as long as it's still healthy. */
+    QString current = this->assignments.value(host);
+    if (!current.isNull()) {
+        QHash<QString, Upstream>::const_iterator it = this->upstreams.constFind(current);
+        if (it != this->upstreams.constEnd() && it->ejectedUntil <= now)
+            return current;
+    }
+
+    /* Pick a healthy proxy according to our strategy. If every single one
+     * has been ejected, go with the one due to return first. */
+    QString best;
+    int n = this->names.size();
+
+    if (this->strategy == RoundRobin) {
+        for (int i = 0; i < n && best.isNull(); i++) {
+            QString name = this->names.at((this->cursor + i) % n);
+            if (this->upstreams[name].ejectedUntil <= now) {
+                best = name;
+                this->cursor = (this->cursor + i + 1) % n;
+            }
+        }
+    } else {
+        foreach (QString name, this->names) {
+            const Upstream & upstream = this->upstreams[name];
+            if (upstream.ejectedUntil > now)
+                continue;
+
+            if (best.isNull() || upstream.outstanding < this->upstreams[best].outstanding)
+                best = name;
+        }
+    }
+
+    if (best.isNull()) {
+        foreach (QString name, this->names) {
+            if (best.isNull() || this->upstreams[name].ejectedUntil < this->upstreams[best].ejectedUntil)
+                best = name;
+        }
+    }
+
+    /* Stickiness is best effort; start over rather than letting the table
+     * grow without bounds. */
+    if (this->assignments.size() >= maxAssignments)
+        this->assignments.clear();
+
+    this->assignments.insert(host, best);
+
+    return best;
+}
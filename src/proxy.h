@@ -0,0 +1,131 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QNetworkProxy>
+#include <QNetworkProxyFactory>
+#include <QStringList>
+#include <QVariant>
+
+
+/* The ProxyPool class spreads requests over a list of upstream proxies.
+ *
+ * Each host is assigned to a proxy the first time it's requested, and sticks
+ * with it for as long as that proxy stays healthy; new hosts are assigned
+ * either round-robin or to the proxy with the fewest requests in flight.
+ * Proxies failing several requests in a row are ejected for a while (longer
+ * each time it happens), and their hosts reassigned.
+ *
+ * Requests started with `begin` are sent through the proxy it returned (see
+ * NetworkTransport), so that their outcome is charged to the proxy which
+ * actually carried them, even if the host has been reassigned in the
+ * meantime. The pool only acts as a proxy factory for everything else.
+ *
+ * With an empty pool, requests go through the application-wide proxy (set
+ * with `--proxy`), or directly. All functions are thread-safe. */
+class ProxyPool : public QNetworkProxyFactory {
+public:
+    /* How hosts are assigned to proxies. */
+    enum Strategy {
+        RoundRobin,
+        LeastOutstanding
+    };
+
+    /* Outcome of a request made through a proxy. */
+    enum Outcome {
+        Succeeded,
+        Failed,
+        Cancelled
+    };
+
+private:
+    /* State kept for each proxy. */
+    struct Upstream {
+        QNetworkProxy proxy;
+
+        /* Requests currently in flight, and totals. */
+        int outstanding;
+        quint64 requests;
+        quint64 errors;
+
+        /* Failures since the last successful request. */
+        int consecutiveErrors;
+
+        /* Moving average of request latency, in milliseconds. */
+        double latency;
+
+        /* When the proxy may be used again, and the number of times it has
+         * been ejected since it last worked. */
+        qint64 ejectedUntil;
+        int ejections;
+    };
+
+    mutable QMutex mutex;
+
+    /* Proxies by name ("host:port"), in the order they were given. */
+    QStringList names;
+    QHash<QString, Upstream> upstreams;
+
+    /* Proxy assigned to each host. */
+    QHash<QString, QString> assignments;
+
+    Strategy strategy;
+    int cursor;
+
+public:
+    /* Construct an empty ProxyPool. */
+    ProxyPool()
+        : strategy(RoundRobin)
+        , cursor(0) {
+    }
+
+    /* Replace the list of proxies. Entries are given as "host:port" (for
+     * HTTP proxies) or as URLs with an "http" or "socks5" scheme, optionally
+     * including credentials. Proxies already in the pool keep their state.
+     * Returns an error message for the first invalid entry, in which case
+     * the pool is left untouched. */
+    QString setProxies(const QStringList & specs);
+
+    /* Set the strategy used for assigning hosts to proxies. */
+    void setStrategy(Strategy strategy);
+
+    /* Called by QNetworkAccessManager to pick the proxy for a connection
+     * not started through `begin` (such as a preconnect). */
+    QList<QNetworkProxy> queryProxy(const QNetworkProxyQuery & query);
+
+    /* Look up a proxy by name. Returns false if it's no longer in the pool. */
+    bool lookup(const QString & name, QNetworkProxy & proxy) const;
+
+    /* Return the name of the proxy currently assigned to a host, and count
+     * a request to it as started. Returns a null string if the pool is
+     * empty. */
+    QString begin(const QString & host);
+
+    /* Report the outcome of a request started with `begin`. */
+    void end(const QString & name, qint64 latency, Outcome outcome);
+
+    /* Return the state of each proxy. */
+    QVariantList stats() const;
+
+    /* Parse a strategy name ("round-robin" or "least-outstanding"). */
+    static bool parseStrategy(const QString name, Strategy & strategy);
+
+private:
+    /* Return the name of the proxy to use for a host, assigning one if
+     * necessary. Must be called with the mutex held. */
+    QString assign(const QString & host, qint64 now);
+};
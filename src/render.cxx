@@ -0,0 +1,230 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <QFile>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QRunnable>
+
+#include "./render.h"
+
+
+/* Upper limits on the number of idle image buffers we hold on to, and on
+ * their combined size in bytes. A single capture at a high scale can take
+ * hundreds of megabytes, which isn't worth keeping around. */
+static const int maxIdleBuffers = 4;
+static const qint64 maxIdleBytes = 64 * 1024 * 1024;
+
+/* Upper limit on the number of captures waiting to be encoded. Each one
+ * holds on to a full image, so a script capturing faster than we can encode
+ * would otherwise keep growing our memory use. */
+static const int maxPendingJobs = 8;
+
+
+/* A RenderJob encodes a captured image and writes it to disk. Instances are
+ * run (and deleted) by the Renderer's thread pool. */
+class RenderJob : public QRunnable {
+public:
+    Renderer * renderer;
+    int id;
+
+    QImage image;
+    QString path;
+    QString format;
+    int quality;
+
+    void run() {
+        QVariantMap result;
+        QString err = this->write();
+
+        if (!err.isNull()) {
+            result["error"] = err;
+        } else {
+            result["path"] = this->path;
+            result["format"] = this->format;
+            result["width"] = this->image.width();
+            result["height"] = this->image.height();
+        }
+
+        /* Hand the buffer back before reporting, so that a capture started in
+         * response to this one can re-use it. */
+        this->renderer->recycle(this->image);
+        this->image = QImage();
+
+        QMetaObject::invokeMethod(this->renderer, "onJobFinished", Qt::QueuedConnection,
+                                  Q_ARG(int, this->id), Q_ARG(QVariantMap, result));
+    }
+
+private:
+    QString write() {
+        /* Raw captures are written as tightly packed, non-premultiplied RGBA
+         * rows, which is what most image processing code expects. */
+        if (this->format == "raw") {
+            QImage raw = this->image.convertToFormat(QImage::Format_RGBA8888);
+
+            QFile file(this->path);
+            if (!file.open(QFile::WriteOnly | QFile::Truncate))
+                return file.errorString();
+
+            qint64 size = qint64(raw.bytesPerLine()) * raw.height();
+            if (file.write((const char *) raw.constBits(), size) < size)
+                return file.errorString();
+
+            return QString();
+        }
+
+        QImageWriter writer(this->path, this->format.toLatin1());
+        writer.setQuality(this->quality);
+
+        if (!writer.write(this->image))
+            return writer.errorString();
+
+        return QString();
+    }
+};
+
+
+Renderer::Renderer(QObject * parent)
+    : QObject(parent)
+    , pool(new QThreadPool(this))
+    , nextId(1)
+    , pending(0) {
+}
+
+
+Renderer::~Renderer() {
+    this->pool->waitForDone();
+}
+
+
+int Renderer::render(QWebFrame * frame, const QVariantMap & options, QString & err) {
+    /* Validate the options before doing anything expensive. */
+    QString path = options["path"].toString();
+    if (path.isEmpty()) {
+        err = "missing output path";
+        return -1;
+    }
+
+    QString format = options["format"].toString().toLower();
+    if (format.isEmpty())
+        format = "png";
+    else if (format == "jpg")
+        format = "jpeg";
+
+    if (format != "png" && format != "jpeg" && format != "raw") {
+        err = "unsupported format";
+        return -1;
+    }
+
+    qreal scale = 1.0;
+    if (options.contains("scale")) {
+        scale = options["scale"].toReal();
+        if (!(scale > 0.0 && scale <= 8.0)) {
+            err = "invalid scale";
+            return -1;
+        }
+    }
+
+    /* Default to capturing the frame's entire viewport. */
+    QRect viewport(QPoint(0, 0), frame->geometry().size());
+    QRect clip = viewport;
+
+    if (options.contains("clip")) {
+        QVariantMap raw = options["clip"].toMap();
+        clip = QRect(raw["x"].toInt(), raw["y"].toInt(),
+                     raw["width"].toInt(), raw["height"].toInt()).intersected(viewport);
+    }
+
+    if (clip.isEmpty()) {
+        err = "empty clip region";
+        return -1;
+    }
+
+    /* Small clips can end up with no pixels at all once scaled down. */
+    QSize size = (QSizeF(clip.size()) * scale).toSize();
+    if (size.isEmpty()) {
+        err = "empty clip region";
+        return -1;
+    }
+
+    if (this->pending >= maxPendingJobs) {
+        err = "too many captures in progress";
+        return -1;
+    }
+
+    /* Paint the frame. */
+    QImage image = this->takeBuffer(size);
+    image.fill(Qt::white);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, scale != 1.0);
+    painter.scale(scale, scale);
+    painter.translate(-clip.topLeft());
+    frame->render(&painter, QRegion(clip));
+    painter.end();
+
+    /* Leave the rest to a worker thread. */
+    RenderJob * job = new RenderJob;
+    job->renderer = this;
+    job->id = this->nextId++;
+    job->image = image;
+    job->path = path;
+    job->format = format;
+    job->quality = options.contains("quality") ? options["quality"].toInt() : -1;
+
+    int id = job->id;
+
+    /* Drop our own reference, or the worker's copy won't be the only one
+     * left by the time the buffer gets recycled. */
+    image = QImage();
+
+    this->pending++;
+    this->pool->start(job);
+
+    return id;
+}
+
+
+void Renderer::recycle(QImage image) {
+    QMutexLocker lock(&this->buffersMutex);
+
+    if (this->buffers.size() >= maxIdleBuffers)
+        return;
+
+    qint64 bytes = image.byteCount();
+    for (int i = 0; i < this->buffers.size(); i++)
+        bytes += this->buffers.at(i).byteCount();
+
+    if (bytes <= maxIdleBytes)
+        this->buffers.append(image);
+}
+
+
+void Renderer::onJobFinished(int id, QVariantMap result) {
+    this->pending--;
+    emit this->finished(id, result);
+}
+
+
+QImage Renderer::takeBuffer(const QSize & size) {
+    QMutexLocker lock(&this->buffersMutex);
+
+    for (int i = 0; i < this->buffers.size(); i++) {
+        if (this->buffers.at(i).size() == size)
+            return this->buffers.takeAt(i);
+    }
+
+    return QImage(size, QImage::Format_ARGB32_Premultiplied);
+}
@@ -0,0 +1,77 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVariant>
+#include <QWebFrame>
+
+
+/* The Renderer class captures the contents of frames. Painting has to happen
+ * on the GUI thread, but everything after that (encoding and writing the
+ * image to disk) is handed off to a pool of worker threads. */
+class Renderer : public QObject {
+    Q_OBJECT
+
+private:
+    /* Worker threads used for encoding captured images. */
+    QThreadPool * pool;
+
+    /* Image buffers no longer in use by any worker, kept around so that we
+     * don't have to allocate a new one for every capture. */
+    QList<QImage> buffers;
+    QMutex buffersMutex;
+
+    /* Identifier handed out to the next render job. */
+    int nextId;
+
+    /* Number of jobs queued or being encoded. */
+    int pending;
+
+public:
+    /* Constructs a new Renderer. */
+    Renderer(QObject * parent = NULL);
+
+    /* Wait for all pending jobs before going away. */
+    ~Renderer();
+
+    /* Paint a frame and queue the resulting image for encoding. Returns the
+     * job's identifier, or -1 (with `err` set) if the options are invalid or
+     * too many captures are waiting to be encoded already.
+     *
+     * Recognized options are `path` (required), `format` ("png", "jpeg" or
+     * "raw"), `quality` (0-100), `scale` and `clip` (an object with `x`, `y`,
+     * `width` and `height` properties, in frame coordinates). */
+    int render(QWebFrame * frame, const QVariantMap & options, QString & err);
+
+    /* Return an image buffer to the free list; called by worker threads. */
+    void recycle(QImage image);
+
+signals:
+    /* Signal emitted once a render job has been encoded and written to
+     * disk (or has failed). */
+    void finished(int id, QVariantMap result);
+
+private slots:
+    /* Receives results from worker threads. */
+    void onJobFinished(int id, QVariantMap result);
+
+private:
+    /* Grab a recycled image buffer of the right size, or allocate a new one. */
+    QImage takeBuffer(const QSize & size);
+};
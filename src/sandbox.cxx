@@ -18,8 +18,16 @@
 #include <QWebPage>
 
 #include "./cookies.h"
+#include "./metrics.h"
+#include "./network.h"
 #include "./sandbox.h"
-#include "./util.h"
+#include "./trace.h"
+
+
+static Counter framesCreated("koala_frames_created_total", "Frames created.");
+static Gauge framesLive("koala_frames_live", "Frames currently alive.");
+static Counter callbacksTotal("koala_callbacks_total", "Callbacks requested from the JavaScript runtime.");
+static Histogram callbackDuration("koala_callback_duration_seconds", "Round trip time of callbacks to the JavaScript runtime.");
 
 
 void Sandbox::launch(QString path, QString src, QStringList args) {
@@ -38,6 +46,10 @@ void Sandbox::launch(QString path, QString src, QStringList args) {
     QObject::connect(this, SIGNAL(frameCreated(QWebFrame *)),
                      this, SLOT(onFrameCreated(QWebFrame *)));
 
+    /* Forward render results to the JavaScript runtime. */
+    QObject::connect(this->renderer, SIGNAL(finished(int, QVariantMap)),
+                     this, SIGNAL(frameRendered(int, QVariantMap)));
+
     /* Load the sandbox page, which will serve as the user script's execution
      * environment, and expose the Sandbox instance. */
     QWebFrame * frame = this->mainFrame();
@@ -46,6 +58,16 @@ void Sandbox::launch(QString path, QString src, QStringList args) {
 }
 
 
+void Sandbox::setScriptStore(ScriptStore * scripts) {
+    this->scripts = scripts;
+}
+
+
+void Sandbox::setLogger(Logger * logger) {
+    this->logger = logger;
+}
+
+
 bool Sandbox::acceptNavigationRequest(QWebFrame * frame,
                                       const QNetworkRequest & req,
                                       QWebPage::NavigationType type) {
@@ -87,11 +109,7 @@ bool Sandbox::acceptNavigationRequest(QWebFrame * frame,
 
 void Sandbox::javaScriptConsoleMessage(const QString & message, int lineNumber,
                                        const QString & sourceID) {
-    Q_UNUSED(lineNumber);
-    Q_UNUSED(sourceID);
-
-    /* TODO: Report this message properly. */
-    qDebug() << message;
+    this->logger->log(LogInfo, 0, sourceID, lineNumber, message);
 }
 
 
@@ -152,15 +170,17 @@ QVariantList Sandbox::getArgs() {
 
 
 QVariantMap Sandbox::readScriptFile(QString path) {
+    TraceSpan span("sandbox", "require", path);
+
     QVariantMap out;
-    QByteArray buf;
+    QString src;
 
-    QString err = readFileUtf8(path, buf);
+    QString err = this->scripts->read(path, src);
     if (!err.isNull()) {
         out["error"] = err;
     } else {
         out["path"] = path;
-        out["src"] = QString::fromUtf8(buf);
+        out["src"] = src;
     }
 
     return out;
@@ -256,12 +276,121 @@ void Sandbox::setCookies(const QVariant & raw) {
 }
 
 
+QVariantMap Sandbox::renderFrame(QObject * handle, const QVariantMap & options) {
+    QVariantMap out;
+    QString err;
+
+    QWebFrame * frame = qobject_cast<QWebFrame *>(handle);
+    if (frame == NULL) {
+        out["error"] = "invalid frame";
+        return out;
+    }
+
+    /* QImageWriter takes qualities from 0 to 100, or -1 for the default. */
+    QVariantMap checked(options);
+    if (checked.contains("quality"))
+        checked["quality"] = qBound(-1, checked["quality"].toInt(), 100);
+
+    int id = this->renderer->render(frame, checked, err);
+    if (id < 0)
+        out["error"] = err;
+    else
+        out["id"] = id;
+
+    return out;
+}
+
+
+QVariantMap Sandbox::fingerprintFrame(QObject * handle) {
+    QVariantMap out;
+
+    QWebFrame * frame = qobject_cast<QWebFrame *>(handle);
+    if (frame == NULL) {
+        out["error"] = "invalid frame";
+        return out;
+    }
+
+    /* Frames without any text (such as ones which haven't loaded yet)
+     * don't get a fingerprint. */
+    quint64 fp;
+    if (simhash(frame->documentElement().toPlainText(), fp))
+        out["fingerprint"] = FingerprintIndex::format(fp);
+
+    return out;
+}
+
+
+void Sandbox::log(QObject * handle, const QString & level, const QString & message,
+                  const QString & source, int line) {
+    LogLevel value = LogInfo;
+    Logger::parseLevel(level, value);
+
+    int id = 0;
+    if (handle != NULL)
+        id = handle->property("koalaId").toInt();
+
+    this->logger->log(value, id, source, line, message);
+}
+
+
+QString Sandbox::setProxies(const QStringList & proxies) {
+    NetworkManager * network = (NetworkManager *) this->networkAccessManager();
+    return network->proxies()->setProxies(proxies);
+}
+
+
+QVariantList Sandbox::getProxies() {
+    NetworkManager * network = (NetworkManager *) this->networkAccessManager();
+    return network->proxies()->stats();
+}
+
+
+void Sandbox::preconnect(const QStringList & hosts) {
+    NetworkManager * network = (NetworkManager *) this->networkAccessManager();
+
+    foreach (QString host, hosts)
+        network->preconnect(QUrl::fromUserInput(host));
+}
+
+
+QVariantMap Sandbox::getStats() {
+    return Metrics::snapshot();
+}
+
+
+QObject * Sandbox::getFrontier() {
+    return this->frontier;
+}
+
+
+QObject * Sandbox::getFingerprints() {
+    return this->fingerprints;
+}
+
+
 void Sandbox::exit(int code) {
     QApplication::instance()->exit(code);
 }
 
 
 void Sandbox::onFrameCreated(QWebFrame * frame) {
+    frame->setProperty("koalaId", this->nextFrameId++);
+
+    framesCreated.add();
+    framesLive.add(1);
+
+    QObject::connect(frame, SIGNAL(destroyed()),
+                     this, SLOT(onFrameDestroyed()));
+
+    if (Tracer::enabled()) {
+        QObject::connect(frame, SIGNAL(loadStarted()),
+                         this, SLOT(onFrameLoadStarted()));
+        QObject::connect(frame, SIGNAL(loadFinished(bool)),
+                         this, SLOT(onFrameLoadFinished(bool)));
+        QObject::connect(frame, SIGNAL(initialLayoutCompleted()),
+                         this, SLOT(onFrameLayoutCompleted()));
+    }
+
     QWebFrame * parent = frame->parentFrame();
     if (parent == this->mainFrame())
         parent = NULL;
@@ -270,7 +399,37 @@ void Sandbox::onFrameCreated(QWebFrame * frame) {
 }
 
 
+void Sandbox::onFrameLoadStarted() {
+    QWebFrame * frame = (QWebFrame *) this->sender();
+    Tracer::begin("frame", "load", frame->property("koalaId").toInt(), frame->requestedUrl().toString());
+}
+
+
+void Sandbox::onFrameLoadFinished(bool ok) {
+    QWebFrame * frame = (QWebFrame *) this->sender();
+    Tracer::end("frame", "load", frame->property("koalaId").toInt(), ok ? "ok" : "failed");
+}
+
+
+void Sandbox::onFrameLayoutCompleted() {
+    QWebFrame * frame = (QWebFrame *) this->sender();
+    Tracer::instant("frame", "layout", frame->url().toString());
+}
+
+
+void Sandbox::onFrameDestroyed() {
+    framesLive.add(-1);
+}
+
+
 QVariant Sandbox::requestCallback(QString name, const QWebFrame * frame, const QVariantList & args) {
+    TraceSpan span("sandbox", "callback", name);
+    qint64 start = Metrics::now();
+
     emit this->callbackRequested(name, (QObject *) frame, args);
+
+    callbacksTotal.add();
+    callbackDuration.record(Metrics::now() - start);
+
     return this->callbackValue;
 }
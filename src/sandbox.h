@@ -20,6 +20,12 @@
 #include <QWebElement>
 #include <QWebPage>
 
+#include "./fingerprint.h"
+#include "./frontier.h"
+#include "./log.h"
+#include "./render.h"
+#include "./scripts.h"
+
 
 /* The Sandbox class hosts and manages a JavaScript execution environment. */
 class Sandbox : public QWebPage {
@@ -42,6 +48,25 @@ private:
      * callback request. */
     QVariant callbackValue;
 
+    /* Frame capture helper. */
+    Renderer * renderer;
+
+    /* Crawl frontier, exposed as `koala.frontier`. */
+    Frontier * frontier;
+
+    /* Index of page fingerprints, exposed as `koala.fingerprints`. */
+    FingerprintIndex * fingerprints;
+
+    /* Where modules loaded with `require` are read from. */
+    ScriptStore * scripts;
+
+    /* Destination for console output. */
+    Logger * logger;
+
+    /* Identifier to be assigned to the next frame created. Identifiers are
+     * stored in each QWebFrame's "koalaId" property. */
+    int nextFrameId;
+
 public:
     /* Construct a new Sandbox instance. */
     Sandbox(QObject * parent = NULL)
@@ -50,9 +75,21 @@ public:
           , mainSource(QString())
           , args(QStringList())
           , sawFirstNavigation(false)
-          , callbackValue(QVariant()) {
+          , callbackValue(QVariant())
+          , renderer(new Renderer(this))
+          , frontier(new Frontier(this))
+          , fingerprints(new FingerprintIndex(this))
+          , scripts(NULL)
+          , logger(NULL)
+          , nextFrameId(1) {
     }
 
+    /* Set the script store used to load modules. */
+    void setScriptStore(ScriptStore * scripts);
+
+    /* Set the logger used for console output. */
+    void setLogger(Logger * logger);
+
     /* Launch the sandbox environment. This effectively means asking the
      * QWebPage to navigate to "qrc:/top.html". */
     void launch(QString path, QString code, QStringList args);
@@ -64,7 +101,11 @@ protected:
                                  const QNetworkRequest & request,
                                  QWebPage::NavigationType type);
 
-    /* Handle a message being written to the JavaScript console. */
+    /* Handle a message being written to the JavaScript console.
+     *
+     * Console calls and uncaught errors are routed through `log` by the
+     * JavaScript runtime, so what ends up here is whatever slips past it
+     * (such as errors thrown from signal handlers), logged as is. */
     void javaScriptConsoleMessage(const QString & message,
                                   int lineNumber, const QString & sourceID);
 
@@ -115,6 +156,11 @@ signals:
      * list. This signal is used by the JavaScript runtime. */
     void cookiesChanged(QVariantList cookies);
 
+    /* Signal that a render job started with `renderFrame` has completed. The
+     * result holds either an `error` message, or the output's `path`,
+     * `format`, `width` and `height`. */
+    void frameRendered(int id, QVariantMap result);
+
 public slots:
     /* Return an object holding the path and source of the main JavaScript
      * file provided by the user. */
@@ -137,6 +183,42 @@ public slots:
     /* Overwrite the cookie jar with a new set of cookies. */
     void setCookies(const QVariant & cookies);
 
+    /* Capture the contents of a frame to a file. Returns an object holding
+     * either the render job's `id`, or an `error` message. */
+    QVariantMap renderFrame(QObject * frame, const QVariantMap & options);
+
+    /* Compute a fingerprint of a frame's text, for finding near-duplicate
+     * pages. Returns an object holding the `fingerprint` (as a string of 16
+     * hex digits), an `error` message, or nothing if the frame has no text. */
+    QVariantMap fingerprintFrame(QObject * frame);
+
+    /* Submit a console message or uncaught error from inside a frame (or
+     * from the main script, if `frame` is null). The level is one of
+     * "debug", "info", "warning" or "error", and `line` is 0 if unknown. */
+    void log(QObject * frame, const QString & level, const QString & message,
+             const QString & source, int line);
+
+    /* Replace the list of upstream proxies, returning an error message if
+     * any of them is invalid. */
+    QString setProxies(const QStringList & proxies);
+
+    /* Return the state of each upstream proxy. */
+    QVariantList getProxies();
+
+    /* Open connections to a list of hosts (or URLs) ahead of time. */
+    void preconnect(const QStringList & hosts);
+
+    /* Return a snapshot of all runtime metrics. */
+    QVariantMap getStats();
+
+    /* Return the crawl frontier, whose slots are called directly by the
+     * JavaScript runtime. */
+    QObject * getFrontier();
+
+    /* Return the fingerprint index, whose slots are likewise called
+     * directly by the JavaScript runtime. */
+    QObject * getFingerprints();
+
     /* Halt execution immediately and exit the process. */
     void exit(int code);
 
@@ -144,6 +226,14 @@ private slots:
     /* Internal handler for the `frameCreated` signal. */
     void onFrameCreated(QWebFrame * frame);
 
+    /* Handlers for frame loading signals, used for tracing. */
+    void onFrameLoadStarted();
+    void onFrameLoadFinished(bool ok);
+    void onFrameLayoutCompleted();
+
+    /* Handler for frames' `destroyed` signal. */
+    void onFrameDestroyed();
+
 private:
     /* Request a callback and grab the return value in one fell swoop. */
     QVariant requestCallback(QString name, const QWebFrame * frame, const QVariantList & args);
@@ -0,0 +1,138 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <string.h>
+
+#include <QDataStream>
+#include <QSaveFile>
+
+#include "./scripts.h"
+#include "./util.h"
+
+
+/* Every bundle file starts with these bytes. */
+static const char bundleMagic[8] = { 'K', 'O', 'A', 'L', 'A', 'B', 'N', 'D' };
+
+
+QString ScriptStore::openBundle(const QString path) {
+    this->bundle.setFileName(path);
+    if (!this->bundle.open(QFile::ReadOnly))
+        return this->bundle.errorString();
+
+    qint64 size = this->bundle.size();
+    const uchar * data = this->bundle.map(0, size);
+    if (data == NULL)
+        return this->bundle.errorString();
+
+    /* The file starts with a magic string and the size of the index, which
+     * is followed by the index itself and then the scripts' sources. */
+    if (size < 12 || memcmp(data, bundleMagic, 8) != 0)
+        return QString("not a bundle file");
+
+    QDataStream header(QByteArray::fromRawData((const char *) data + 8, 4));
+    quint32 indexSize;
+    header >> indexSize;
+
+    if (qint64(indexSize) > size - 12)
+        return QString("corrupt bundle index");
+
+    QDataStream index(QByteArray::fromRawData((const char *) data + 12, indexSize));
+    index.setVersion(QDataStream::Qt_5_0);
+
+    qint64 base = 12 + indexSize;
+    quint32 count;
+    index >> count;
+
+    for (quint32 i = 0; i < count; i++) {
+        QString name;
+        qint64 offset, length;
+        index >> name >> offset >> length;
+
+        if (index.status() != QDataStream::Ok || offset < 0 || length < 0 ||
+                base + offset + length > size)
+            return QString("corrupt bundle index");
+
+        this->bundleIndex.insert(name, qMakePair(base + offset, length));
+    }
+
+    this->bundleData = data;
+
+    return QString();
+}
+
+
+void ScriptStore::record() {
+    this->recording = true;
+}
+
+
+QString ScriptStore::writeBundle(const QString path) {
+    QByteArray index;
+    QByteArray data;
+
+    QDataStream out(&index, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(this->recorded.size());
+
+    foreach (QString name, this->recorded) {
+        QString source;
+        QString err = this->read(name, source);
+        if (!err.isNull())
+            return err;
+
+        QByteArray utf8 = source.toUtf8();
+        out << name << qint64(data.size()) << qint64(utf8.size());
+        data += utf8;
+    }
+
+    /* Write the whole thing in one go, and only replace the destination file
+     * once everything has been written successfully. */
+    QSaveFile file(path);
+    if (!file.open(QFile::WriteOnly))
+        return file.errorString();
+
+    QDataStream header(&file);
+    header.writeRawData(bundleMagic, 8);
+    header << quint32(index.size());
+
+    file.write(index);
+    file.write(data);
+
+    if (!file.commit())
+        return file.errorString();
+
+    return QString();
+}
+
+
+QString ScriptStore::read(const QString path, QString & source) {
+    /* Bundled scripts are decoded directly from the mapped file. */
+    if (this->bundleData != NULL && this->bundleIndex.contains(path)) {
+        QPair<qint64, qint64> loc = this->bundleIndex.value(path);
+        source = QString::fromUtf8((const char *) this->bundleData + loc.first, int(loc.second));
+    } else {
+        QByteArray buf;
+        QString err = readFileUtf8(path, buf);
+        if (!err.isNull())
+            return err;
+
+        source = QString::fromUtf8(buf);
+    }
+
+    /* QRC files are always available, so there's no point bundling them. */
+    if (this->recording && !path.startsWith(':') && !this->recorded.contains(path))
+        this->recorded.append(path);
+
+    return QString();
+}
@@ -0,0 +1,68 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+
+/* The ScriptStore class is where all script sources (the main script as well
+ * as every module loaded through `require`) are read from. It can serve
+ * scripts straight out of a memory-mapped bundle file instead of going to
+ * the disk at all. (Each module is only read once per run anyway, as the
+ * JavaScript runtime keeps loaded modules around.)
+ *
+ * A bundle is produced by running a script with `--write-bundle`, which
+ * records every script file read during the run and packs them together when
+ * the process exits. Scripts are looked up by absolute path, so a bundle is
+ * only useful when the scripts live at the same paths on both ends. */
+class ScriptStore : public QObject {
+    Q_OBJECT
+
+private:
+    /* Memory-mapped bundle, and the location of each script inside it. */
+    QFile bundle;
+    const uchar * bundleData;
+    QHash<QString, QPair<qint64, qint64> > bundleIndex;
+
+    /* Paths of every script read from disk, in the order they were first
+     * loaded. Only maintained when `recording` is set. */
+    bool recording;
+    QStringList recorded;
+
+public:
+    /* Construct a new ScriptStore. */
+    ScriptStore(QObject * parent = NULL)
+        : QObject(parent)
+        , bundleData(NULL)
+        , recording(false) {
+    }
+
+    /* Memory-map a bundle file and serve scripts from it. */
+    QString openBundle(const QString path);
+
+    /* Start keeping track of all scripts read from disk. */
+    void record();
+
+    /* Pack all recorded scripts into a bundle file. */
+    QString writeBundle(const QString path);
+
+    /* Read a UTF-8 encoded script, from the bundle if possible, and from
+     * disk (or from the QRC store) otherwise. */
+    QString read(const QString path, QString & source);
+};
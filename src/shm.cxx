@@ -0,0 +1,167 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./shm.h"
+
+
+SharedRing::~SharedRing() {
+    if (this->base == NULL)
+        return;
+
+    munmap(this->base, size_t(this->length));
+    shm_unlink(this->path.toLocal8Bit().constData());
+}
+
+
+QString SharedRing::create(const QString & name, qint64 size, bool writable) {
+    QByteArray path = name.toLocal8Bit();
+    int fd = shm_open(path.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    /* A region by the same name may have been left behind by an earlier
+     * process which had the same pid and didn't exit cleanly. */
+    if (fd < 0 && errno == EEXIST) {
+        shm_unlink(path.constData());
+        fd = shm_open(path.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+
+    if (fd < 0)
+        return QString::fromLocal8Bit(strerror(errno));
+
+    if (ftruncate(fd, off_t(size)) < 0) {
+        QString err = QString::fromLocal8Bit(strerror(errno));
+        close(fd);
+        shm_unlink(path.constData());
+        return err;
+    }
+
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void * base = mmap(NULL, size_t(size), prot, MAP_SHARED, fd, 0);
+
+    /* The mapping stays valid after the descriptor has been closed. */
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        shm_unlink(path.constData());
+        return QString::fromLocal8Bit(strerror(errno));
+    }
+
+    this->path = name;
+    this->length = size;
+    this->base = (char *) base;
+
+    return QString();
+}
+
+
+QString SharedRing::name() const {
+    return this->path;
+}
+
+
+qint64 SharedRing::size() const {
+    return this->length;
+}
+
+
+qint64 SharedRing::used() const {
+    qint64 used = 0;
+
+    for (int i = 0; i < this->allocated.size(); i++)
+        used += this->allocated[i].length;
+
+    return used;
+}
+
+
+quint32 SharedRing::write(const QByteArray & data, qint64 & offset) {
+    qint64 length = data.size();
+
+    if (this->base == NULL || length == 0 || length > this->length)
+        return 0;
+
+    if (this->allocated.isEmpty()) {
+        offset = 0;
+    } else {
+        /* Slots are laid out back to back, wrapping around to the start of
+         * the region when there isn't enough room left at the end. Once
+         * wrapped, the newest slot lies before the oldest one. */
+        qint64 tail = this->allocated.first().offset;
+        bool wrapped = this->allocated.last().offset < tail;
+
+        if (!wrapped && this->length - this->head >= length)
+            offset = this->head;
+        else if (!wrapped && tail >= length)
+            offset = 0;
+        else if (wrapped && tail - this->head >= length)
+            offset = this->head;
+        else
+            return 0;
+    }
+
+    Slot slot;
+    slot.id = this->nextId++;
+    slot.offset = offset;
+    slot.length = length;
+    slot.released = false;
+
+    /* Identifiers are never 0, that's our "no room" value. */
+    if (this->nextId == 0)
+        this->nextId = 1;
+
+    memcpy(this->base + offset, data.constData(), size_t(length));
+
+    this->allocated.append(slot);
+    this->head = offset + length;
+
+    return slot.id;
+}
+
+
+bool SharedRing::release(quint32 id) {
+    bool found = false;
+
+    for (int i = 0; i < this->allocated.size(); i++) {
+        if (this->allocated[i].id == id && !this->allocated[i].released) {
+            this->allocated[i].released = true;
+            found = true;
+            break;
+        }
+    }
+
+    /* Reclaim everything up to the oldest slot still in use. */
+    while (!this->allocated.isEmpty() && this->allocated.first().released)
+        this->allocated.removeFirst();
+
+    if (this->allocated.isEmpty())
+        this->head = 0;
+
+    return found;
+}
+
+
+bool SharedRing::read(qint64 offset, qint64 length, QByteArray & data) const {
+    if (this->base == NULL || offset < 0 || length < 0 || offset > this->length - length)
+        return false;
+
+    data = QByteArray(this->base + offset, int(length));
+
+    return true;
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+
+/* The SharedRing class manages a POSIX shared memory region used to pass
+ * large messages to and from the controlling process without pushing them
+ * through a pipe.
+ *
+ * When koala is the writer, the region is used as a ring buffer: each
+ * message is copied into a contiguous slot, and slots stay allocated until
+ * they're explicitly released (in any order). Space is reclaimed from the
+ * oldest slot onwards, so a slot that's never released will eventually
+ * stall the ring, and later messages fall back to being sent inline. */
+class SharedRing {
+private:
+    /* An allocated range of the region. */
+    struct Slot {
+        quint32 id;
+        qint64 offset;
+        qint64 length;
+        bool released;
+    };
+
+    QString path;
+    qint64 length;
+    char * base;
+
+    /* Allocated slots, oldest first. */
+    QList<Slot> allocated;
+
+    /* Where the next slot would start, and its identifier. */
+    qint64 head;
+    quint32 nextId;
+
+public:
+    /* Construct an unmapped SharedRing. */
+    SharedRing()
+        : length(0)
+        , base(NULL)
+        , head(0)
+        , nextId(1) {
+    }
+
+    /* Unmap and unlink the region. */
+    ~SharedRing();
+
+    /* Create and map a new region with the given name (which should start
+     * with a slash). Regions only the controlling process writes to are
+     * mapped read-only. */
+    QString create(const QString & name, qint64 size, bool writable);
+
+    /* Return the region's name and size. */
+    QString name() const;
+    qint64 size() const;
+
+    /* Return the number of bytes held by allocated slots. */
+    qint64 used() const;
+
+    /* Copy data into a new slot. Returns the slot's identifier (with
+     * `offset` set), or 0 if there isn't enough room. */
+    quint32 write(const QByteArray & data, qint64 & offset);
+
+    /* Release a slot, reclaiming its space once every slot allocated
+     * before it has been released as well. */
+    bool release(quint32 id);
+
+    /* Copy data out of the region, provided the range is within bounds. */
+    bool read(qint64 offset, qint64 length, QByteArray & data) const;
+
+private:
+    Q_DISABLE_COPY(SharedRing)
+};
@@ -12,21 +12,86 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <sys/select.h>
+#include <unistd.h>
 
+#include "./metrics.h"
 #include "./stdio.h"
+#include "./trace.h"
+
+
+static Counter messagesReceived("koala_stdio_received_messages_total", "Messages read from stdin.");
+static Counter messagesSent("koala_stdio_sent_messages_total", "Messages written to stdout.");
+static Counter bytesReceived("koala_stdio_received_bytes_total", "Bytes read from stdin.");
+static Counter bytesSent("koala_stdio_sent_bytes_total", "Bytes written to stdout.");
+static Counter shmBytesReceived("koala_stdio_shm_received_bytes_total", "Bytes of messages read from shared memory.");
+static Counter shmBytesSent("koala_stdio_shm_sent_bytes_total", "Bytes of messages written to shared memory.");
+static Counter shmFallbacks("koala_stdio_shm_fallbacks_total", "Large messages written to stdout for lack of room in shared memory.");
+static Gauge shmInUse("koala_stdio_shm_used_bytes", "Bytes of shared memory held by messages not yet released.");
 
 
 StdioHelper::StdioHelper(QObject * parent)
     : QObject(parent)
-    , notifier(new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this)) {
+    , notifier(new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this))
+    , threshold(0) {
     QObject::connect(this->notifier, SIGNAL(activated(int)),
                      this, SLOT(onReadReady()));
 }
 
 
+QString StdioHelper::enableSharedMemory(qint64 size, int threshold) {
+    QString prefix = QString("/koala-%1-").arg(getpid());
+
+    QString err = this->outbound.create(prefix + "out", size, true);
+    if (err.isNull())
+        err = this->inbound.create(prefix + "in", size, false);
+    if (!err.isNull())
+        return err;
+
+    this->threshold = qMax(1, threshold);
+
+    /* Let the controlling process know where to find the regions. */
+    QJsonObject regions;
+    regions["out"] = this->outbound.name();
+    regions["in"] = this->inbound.name();
+    regions["size"] = double(size);
+
+    QJsonObject handshake;
+    handshake["@shm"] = regions;
+
+    this->write(QJsonDocument(handshake).toJson(QJsonDocument::Compact));
+
+    return QString();
+}
+
+
 void StdioHelper::send(QString message) {
-    fprintf(stdout, "%s\n", qPrintable(message));
+    TraceSpan span("stdio", "write");
+
+    QByteArray line = message.toUtf8();
+
+    /* Pass large messages through shared memory, if we can find the room;
+     * otherwise they're written inline, like any other message. */
+    if (this->threshold > 0 && line.size() >= this->threshold) {
+        qint64 offset;
+        quint32 id = this->outbound.write(line, offset);
+
+        if (id != 0) {
+            shmBytesSent.add(line.size());
+            shmInUse.set(this->outbound.used());
+
+            line = QString("{\"@shm\":{\"id\":%1,\"offset\":%2,\"length\":%3}}")
+                       .arg(id).arg(offset).arg(line.size()).toUtf8();
+        } else {
+            shmFallbacks.add();
+        }
+    }
+
+    this->write(line);
+    messagesSent.add();
 }
 
 
@@ -35,6 +100,8 @@ void StdioHelper::onReadReady() {
     fd_set fds;
     char buf[1024];
 
+    TraceSpan span("stdio", "read");
+
     FD_ZERO(&fds);
 
     /* Keep reading from stdin until we're out of data. */
@@ -46,9 +113,17 @@ void StdioHelper::onReadReady() {
             break;
 
         ssize_t rem = read(STDIN_FILENO, buf, 1024);
+
+        /* Stop listening once we hit end of file. A descriptor at EOF stays
+         * readable forever, so otherwise the notifier keeps firing and the
+         * event loop spins at full CPU for as long as the process runs. */
+        if (rem == 0)
+            this->notifier->setEnabled(false);
         if (rem <= 0)
             break;
 
+        bytesReceived.add(rem);
+
         char * cur = buf;
 
         for (;;) {
@@ -71,7 +146,7 @@ void StdioHelper::onReadReady() {
 
             /* Let any listeners know we've now read a full line. */
             this->buffer.append(cur, newline - 1);
-            emit this->received(QString::fromUtf8(this->buffer));
+            this->dispatch(this->buffer);
             this->buffer.truncate(0);
 
             /* Move forward. */
@@ -80,3 +155,64 @@ void StdioHelper::onReadReady() {
         }
     }
 }
+
+
+void StdioHelper::dispatch(const QByteArray & line) {
+    /* Look out for shared memory descriptors and releases, which are only
+     * ever sent once shared memory has been enabled. */
+    if (this->threshold > 0 && (line.startsWith("{\"@release\":") || line.startsWith("{\"@shm\":"))) {
+        QJsonObject envelope = QJsonDocument::fromJson(line).object();
+
+        if (envelope.contains("@release")) {
+            foreach (QJsonValue id, envelope["@release"].toArray())
+                this->outbound.release(quint32(id.toDouble()));
+
+            shmInUse.set(this->outbound.used());
+            return;
+        }
+
+        if (envelope.contains("@shm")) {
+            QJsonObject slot = envelope["@shm"].toObject();
+            QByteArray data;
+
+            bool ok = this->inbound.read(qint64(slot["offset"].toDouble()),
+                                         qint64(slot["length"].toDouble()), data);
+
+            /* Hand the slot back straight away, even if the descriptor was
+             * out of bounds, so that the controlling process can re-use it. */
+            QJsonArray ids;
+            ids.append(slot["id"]);
+
+            QJsonObject release;
+            release["@release"] = ids;
+
+            this->write(QJsonDocument(release).toJson(QJsonDocument::Compact));
+
+            if (ok) {
+                shmBytesReceived.add(data.size());
+                messagesReceived.add();
+                emit this->received(QString::fromUtf8(data));
+            }
+
+            return;
+        }
+    }
+
+    messagesReceived.add();
+    emit this->received(QString::fromUtf8(line));
+}
+
+
+void StdioHelper::write(const QByteArray & line) {
+    fprintf(stdout, "%s\n", line.constData());
+
+    /* Whoever is on the other end may well be waiting for this message
+     * before sending anything else, and stdout is fully buffered when it's
+     * a pipe, so don't let it sit in a buffer; a request/reply exchange
+     * would stall until some later message happened to fill the buffer.
+     * This costs a `write` per message. With --shm, large payloads skip
+     * the pipe, so the line flushed here is only a short descriptor. */
+    fflush(stdout);
+
+    bytesSent.add(line.size() + 1);
+}
@@ -17,8 +17,23 @@
 #include <QByteArray>
 #include <QSocketNotifier>
 
+#include "./shm.h"
 
-/* The StdioHelper class reads/writes lines of UTF-8 text to stdin/stdout. */
+
+/* The StdioHelper class reads/writes lines of UTF-8 text to stdin/stdout.
+ *
+ * Optionally, large messages can be passed through shared memory instead.
+ * Once enabled, the first line written to stdout names the two regions
+ * involved, as `{"@shm":{"out":name,"in":name,"size":n}}`. Messages of at
+ * least a threshold size are then copied into the "out" region, and only a
+ * descriptor, `{"@shm":{"id":n,"offset":n,"length":n}}`, is written to
+ * stdout. The controlling process has to release each slot once it's done
+ * with it, by writing `{"@release":[id, ...]}` to stdin; until then, the
+ * slot's space can't be re-used.
+ *
+ * The same works the other way around: the controlling process may place
+ * messages in the "in" region (managing its space itself) and write a
+ * descriptor to stdin. We release those slots right after copying them. */
 class StdioHelper : public QObject {
     Q_OBJECT
 
@@ -29,10 +44,21 @@ private:
     /* Buffer storing input data until a complete line has been read. */
     QByteArray buffer;
 
+    /* Shared memory regions for outgoing and incoming messages, and the
+     * size from which outgoing messages are passed through shared memory.
+     * A threshold of 0 means shared memory isn't used. */
+    SharedRing outbound;
+    SharedRing inbound;
+    int threshold;
+
 public:
     /* Constructor. */
     StdioHelper(QObject * parent = NULL);
 
+    /* Start passing messages of `threshold` bytes or more through a pair
+     * of shared memory regions, each `size` bytes large. */
+    QString enableSharedMemory(qint64 size, int threshold);
+
 public slots:
     /* Write a message as a single line to stdout. */
     void send(QString message);
@@ -45,4 +71,11 @@ private slots:
     /* This function handles the signals emitted by our QSocketNotifier
      * telling is that there is more data to be read from stdin. */
     void onReadReady();
+
+private:
+    /* Handle a complete line of input. */
+    void dispatch(const QByteArray & line);
+
+    /* Write a line to stdout. */
+    void write(const QByteArray & line);
 };
@@ -0,0 +1,155 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#include "./metrics.h"
+#include "./tls.h"
+#include "./util.h"
+
+
+static Counter ticketsOffered("koala_tls_session_tickets_offered_total", "Connections attempted with a cached TLS session ticket.");
+static Gauge ticketsCached("koala_tls_session_tickets_cached", "TLS session tickets currently cached.");
+
+
+/* Servers rarely accept tickets older than this, so there's no point in
+ * holding on to them any longer. */
+static const qint64 maxTicketAge = 2 * 3600 * 1000;
+
+/* Return the "host:port" key for a URL. */
+static QString keyOf(const QUrl & url) {
+    return url.host().toLower() + ":" + QString::number(url.port(443));
+}
+
+
+QString loadCertificates(const QString glob, QList<QSslCertificate> & certs) {
+    QFileInfo info(glob);
+    QDir dir = info.dir();
+
+    QStringList names = dir.entryList(QStringList() << info.fileName(), QDir::Files, QDir::Name);
+
+    foreach (QString name, names) {
+        QByteArray buf;
+        QString err = readFileUtf8(dir.filePath(name), buf);
+        if (!err.isNull())
+            return err;
+
+        certs += QSslCertificate::fromData(buf, QSsl::Pem);
+    }
+
+    return QString();
+}
+
+
+bool TlsSessionCache::apply(const QUrl & url, QSslConfiguration & config) const {
+    QMutexLocker lock(&this->mutex);
+
+    QHash<QString, Entry>::const_iterator it = this->entries.constFind(keyOf(url));
+    if (it == this->entries.constEnd())
+        return false;
+
+    if (QDateTime::currentMSecsSinceEpoch() - it->received >= maxTicketAge)
+        return false;
+
+    config.setSessionTicket(it->ticket);
+    ticketsOffered.add();
+
+    return true;
+}
+
+
+void TlsSessionCache::store(const QUrl & url, const QSslConfiguration & config) {
+    QByteArray ticket = config.sessionTicket();
+    if (ticket.isEmpty())
+        return;
+
+    Entry entry;
+    entry.ticket = ticket;
+    entry.received = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker lock(&this->mutex);
+    this->entries.insert(keyOf(url), entry);
+    ticketsCached.set(this->entries.size());
+}
+
+
+QString TlsSessionCache::load(const QString path) {
+    QFile file(path);
+
+    /* A missing file simply means there's nothing to load yet. */
+    if (!file.exists())
+        return QString();
+
+    /* The file holds session secrets, so refuse to trust one that other
+     * users could have read (or planted). */
+    if (file.permissions() & (QFile::ReadGroup | QFile::ReadOther | QFile::WriteGroup | QFile::WriteOther))
+        return QString("file is accessible to other users");
+
+    if (!file.open(QFile::ReadOnly))
+        return file.errorString();
+
+    QDataStream in(&file);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    quint32 count;
+
+    in >> count;
+
+    QMutexLocker lock(&this->mutex);
+
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString key;
+        Entry entry;
+
+        in >> key >> entry.ticket >> entry.received;
+
+        if (in.status() == QDataStream::Ok && now - entry.received < maxTicketAge)
+            this->entries.insert(key, entry);
+    }
+
+    ticketsCached.set(this->entries.size());
+
+    return QString();
+}
+
+
+QString TlsSessionCache::save(const QString path) const {
+    QSaveFile file(path);
+    if (!file.open(QFile::WriteOnly))
+        return file.errorString();
+
+    /* Session tickets carry the sessions' master secrets, so keep them to
+     * ourselves whatever the umask (or an existing file's mode) says. */
+    if (!file.setPermissions(QFile::ReadOwner | QFile::WriteOwner))
+        return file.errorString();
+
+    QMutexLocker lock(&this->mutex);
+
+    QDataStream out(&file);
+    out << quint32(this->entries.size());
+
+    QHash<QString, Entry>::const_iterator it;
+    for (it = this->entries.constBegin(); it != this->entries.constEnd(); ++it)
+        out << it.key() << it->ticket << it->received;
+
+    if (!file.commit())
+        return file.errorString();
+
+    return QString();
+}
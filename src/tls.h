@@ -0,0 +1,70 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QSslCertificate>
+#include <QSslConfiguration>
+#include <QUrl>
+
+
+/* Load all PEM-encoded certificates matching a glob (with wildcards allowed
+ * in the file name only). Returns an error message if a matching file
+ * couldn't be read. */
+QString loadCertificates(const QString glob, QList<QSslCertificate> & certs);
+
+
+/* The TlsSessionCache class holds on to TLS session tickets handed out by
+ * servers, keyed by "host:port", so that later connections to the same host
+ * (from any frame, or from a later run if the cache is persisted) can
+ * resume the session with an abbreviated handshake. */
+class TlsSessionCache : public QObject {
+    Q_OBJECT
+
+private:
+    /* A session ticket and when we received it. */
+    struct Entry {
+        QByteArray ticket;
+        qint64 received;
+    };
+
+    /* Cached tickets, keyed by "host:port". Tickets are stored from the
+     * network thread, so access is guarded by a mutex. */
+    QHash<QString, Entry> entries;
+    mutable QMutex mutex;
+
+public:
+    /* Construct a new TlsSessionCache. */
+    TlsSessionCache(QObject * parent = NULL)
+        : QObject(parent) {
+    }
+
+    /* Attach the cached session ticket for a URL's host (if we have one) to
+     * an SSL configuration. Returns true if a ticket was attached. */
+    bool apply(const QUrl & url, QSslConfiguration & config) const;
+
+    /* Remember the session ticket negotiated for a URL's host. */
+    void store(const QUrl & url, const QSslConfiguration & config);
+
+    /* Load and save the cache, for re-use between runs. The file is saved
+     * readable by its owner only, and loading refuses files that other
+     * users can access. */
+    QString load(const QString path);
+    QString save(const QString path) const;
+};
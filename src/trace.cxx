@@ -0,0 +1,175 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <stdio.h>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+#include "./trace.h"
+
+
+/* Events are written to disk whenever this much has been buffered. */
+static const int flushThreshold = 256 * 1024;
+
+
+QAtomicInt Tracer::active(0);
+
+static QFile * file = NULL;
+static QByteArray buffer;
+static QMutex mutex;
+static QElapsedTimer timer;
+
+
+/* Append a string to the buffer as a JSON string literal. */
+static void appendJsonString(QByteArray & out, const QByteArray & str) {
+    out += '"';
+
+    for (int i = 0; i < str.size(); i++) {
+        unsigned char c = (unsigned char) str.at(i);
+
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += char(c);
+        }
+    }
+
+    out += '"';
+}
+
+
+QString Tracer::open(const QString path) {
+    QMutexLocker lock(&mutex);
+
+    file = new QFile(path);
+    if (!file->open(QFile::WriteOnly | QFile::Truncate)) {
+        QString err = file->errorString();
+        delete file;
+        file = NULL;
+        return err;
+    }
+
+    /* Viewers accept a trace without the closing bracket, which means the
+     * file remains usable even if we never get to call `close`. */
+    buffer.reserve(flushThreshold * 2);
+    buffer = "[\n";
+
+    timer.start();
+    active.storeRelease(1);
+
+    return QString();
+}
+
+
+void Tracer::close() {
+    QMutexLocker lock(&mutex);
+
+    if (file == NULL)
+        return;
+
+    active.storeRelease(0);
+
+    buffer += "{}]\n";
+    file->write(buffer);
+    file->close();
+
+    delete file;
+    file = NULL;
+    buffer.clear();
+}
+
+
+qint64 Tracer::now() {
+    return timer.nsecsElapsed() / 1000;
+}
+
+
+void Tracer::span(const char * category, const char * name, qint64 start, qint64 end,
+                  const QString & detail) {
+    event('X', category, name, start, end - start, 0, detail);
+}
+
+
+void Tracer::begin(const char * category, const char * name, quintptr id,
+                   const QString & detail) {
+    if (enabled())
+        event('b', category, name, now(), 0, id, detail);
+}
+
+
+void Tracer::end(const char * category, const char * name, quintptr id,
+                 const QString & detail) {
+    if (enabled())
+        event('e', category, name, now(), 0, id, detail);
+}
+
+
+void Tracer::instant(const char * category, const char * name, const QString & detail) {
+    if (enabled())
+        event('i', category, name, now(), 0, 0, detail);
+}
+
+
+void Tracer::event(char phase, const char * category, const char * name, qint64 ts,
+                   qint64 dur, quintptr id, const QString & detail) {
+    char head[192];
+    unsigned long long tid = (unsigned long long) (quintptr) QThread::currentThreadId();
+
+    /* Do as much of the formatting as possible before taking the lock. */
+    int n = snprintf(head, sizeof(head), "{\"ph\":\"%c\",\"pid\":1,\"tid\":%llu,\"ts\":%lld",
+                     phase, tid, (long long) ts);
+
+    if (phase == 'X')
+        n += snprintf(head + n, sizeof(head) - n, ",\"dur\":%lld", (long long) dur);
+    else if (phase == 'b' || phase == 'e')
+        n += snprintf(head + n, sizeof(head) - n, ",\"id\":\"0x%llx\"", (unsigned long long) id);
+    else if (phase == 'i')
+        n += snprintf(head + n, sizeof(head) - n, ",\"s\":\"t\"");
+
+    QByteArray line(head, n);
+
+    line += ",\"cat\":";
+    appendJsonString(line, category);
+    line += ",\"name\":";
+    appendJsonString(line, name);
+
+    if (!detail.isEmpty()) {
+        line += ",\"args\":{\"detail\":";
+        appendJsonString(line, detail.toUtf8());
+        line += '}';
+    }
+
+    line += "},\n";
+
+    QMutexLocker lock(&mutex);
+
+    if (file == NULL)
+        return;
+
+    buffer += line;
+
+    if (buffer.size() >= flushThreshold) {
+        file->write(buffer);
+        buffer.truncate(0);
+    }
+}
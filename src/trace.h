@@ -0,0 +1,91 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QString>
+
+
+/* The Tracer class writes Chrome trace-event JSON (as understood by
+ * chrome://tracing and similar viewers) to a file, when enabled with
+ * `--trace`. Events are formatted into an in-memory buffer which is written
+ * out in large chunks, and all functions return immediately when tracing
+ * is disabled, so instrumented code paths don't pay for it otherwise.
+ *
+ * All functions are safe to call from any thread. */
+class Tracer {
+public:
+    /* Start writing trace events to a file. */
+    static QString open(const QString path);
+
+    /* Flush remaining events and close the trace file. */
+    static void close();
+
+    /* Whether tracing is enabled. */
+    static bool enabled() {
+        return active.loadAcquire() != 0;
+    }
+
+    /* Current timestamp, in microseconds since tracing was enabled. */
+    static qint64 now();
+
+    /* Record a complete, synchronous span. */
+    static void span(const char * category, const char * name, qint64 start, qint64 end,
+                     const QString & detail = QString());
+
+    /* Record the start and end of an asynchronous span. Overlapping spans
+     * within the same category are told apart by their `id`. */
+    static void begin(const char * category, const char * name, quintptr id,
+                      const QString & detail = QString());
+    static void end(const char * category, const char * name, quintptr id,
+                    const QString & detail = QString());
+
+    /* Record a single point in time. */
+    static void instant(const char * category, const char * name,
+                        const QString & detail = QString());
+
+private:
+    /* Set while a trace file is open. Read from any thread, without taking
+     * the buffer's mutex. */
+    static QAtomicInt active;
+
+    /* Format and buffer a single event. */
+    static void event(char phase, const char * category, const char * name, qint64 ts,
+                      qint64 dur, quintptr id, const QString & detail);
+};
+
+
+/* The TraceSpan class records a synchronous span covering its own
+ * lifetime. */
+class TraceSpan {
+private:
+    const char * category;
+    const char * name;
+    QString detail;
+    qint64 start;
+
+public:
+    TraceSpan(const char * category, const char * name, const QString & detail = QString())
+        : category(category)
+        , name(name)
+        , detail(Tracer::enabled() ? detail : QString())
+        , start(Tracer::enabled() ? Tracer::now() : 0) {
+    }
+
+    ~TraceSpan() {
+        if (Tracer::enabled())
+            Tracer::span(this->category, this->name, this->start, Tracer::now(), this->detail);
+    }
+};
@@ -0,0 +1,337 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <QBuffer>
+#include <QNetworkCookie>
+#include <string.h>
+
+#include "./proxy.h"
+#include "./transport.h"
+
+
+/* Response data is passed on to the GUI thread once this much of it has
+ * piled up, or when no more data has arrived for `flushDelay` milliseconds. */
+static const int chunkSize = 64 * 1024;
+static const int flushDelay = 2;
+
+
+/* Reply attributes forwarded to the GUI thread. */
+static const QNetworkRequest::Attribute forwardedAttributes[] = {
+    QNetworkRequest::HttpStatusCodeAttribute,
+    QNetworkRequest::HttpReasonPhraseAttribute,
+    QNetworkRequest::RedirectionTargetAttribute,
+    QNetworkRequest::ConnectionEncryptedAttribute,
+    QNetworkRequest::SourceIsFromCacheAttribute,
+    QNetworkRequest::HttpPipeliningWasUsedAttribute,
+    QNetworkRequest::SpdyWasUsedAttribute,
+};
+
+
+QNetworkReply * NetworkTransport::open(QNetworkAccessManager::Operation op,
+                                       const QNetworkRequest & req, QIODevice * body,
+                                       const QString & proxy) {
+    /* Requests for proxies which have since left the pool go through
+     * whatever the pool picks now; their outcome is ignored anyway. */
+    QNetworkProxy upstream;
+    ProxyPool * pool = (ProxyPool *) this->proxyFactory();
+
+    if (proxy.isEmpty() || pool == NULL || !pool->lookup(proxy, upstream))
+        return this->createRequest(op, req, body);
+
+    NetworkTransport *& manager = this->upstreams[proxy];
+    if (manager == NULL)
+        manager = new NetworkTransport(this->sessions, this);
+
+    if (manager->proxy() != upstream)
+        manager->setProxy(upstream);
+
+    return manager->createRequest(op, req, body);
+}
+
+
+TlsSessionCache * NetworkTransport::tlsSessions() const {
+    return this->sessions;
+}
+
+
+void NetworkTransport::start(QObject * job) {
+    /* Parent the job to us, so that any job still running when the network
+     * thread shuts down is cleaned up along with the transport. */
+    job->setParent(this);
+    ((TransportJob *) job)->start(this);
+}
+
+
+void NetworkTransport::preconnect(const QString & host, int port, bool encrypted,
+                                  const QSslConfiguration & config) {
+    if (encrypted)
+        this->connectToHostEncrypted(host, quint16(port), config);
+    else
+        this->connectToHost(host, quint16(port));
+}
+
+
+void TransportJob::start(NetworkTransport * transport) {
+    this->sessions = transport->tlsSessions();
+
+    this->flushTimer = new QTimer(this);
+    this->flushTimer->setSingleShot(true);
+    this->flushTimer->setInterval(flushDelay);
+
+    QObject::connect(this->flushTimer, SIGNAL(timeout()),
+                     this, SLOT(flush()));
+
+    /* Uploads always get a body, even an empty one, so that they're still
+     * sent with a "Content-Length: 0" header. */
+    bool upload = this->op == QNetworkAccessManager::PostOperation ||
+                  this->op == QNetworkAccessManager::PutOperation;
+
+    QBuffer * buffer = NULL;
+    if (upload || !this->body.isEmpty()) {
+        buffer = new QBuffer(this);
+        buffer->setData(this->body);
+        buffer->open(QIODevice::ReadOnly);
+    }
+
+    this->reply = transport->open(this->op, this->request, buffer, this->proxy);
+    this->reply->setParent(this);
+
+    QObject::connect(this->reply, SIGNAL(metaDataChanged()),
+                     this, SLOT(onMetaDataChanged()));
+    QObject::connect(this->reply, SIGNAL(readyRead()),
+                     this, SLOT(onReadyRead()));
+    QObject::connect(this->reply, SIGNAL(encrypted()),
+                     this, SLOT(onEncrypted()));
+    QObject::connect(this->reply, SIGNAL(finished()),
+                     this, SLOT(onFinished()));
+    QObject::connect(this->reply, SIGNAL(downloadProgress(qint64, qint64)),
+                     this, SIGNAL(downloadProgress(qint64, qint64)));
+    QObject::connect(this->reply, SIGNAL(uploadProgress(qint64, qint64)),
+                     this, SIGNAL(uploadProgress(qint64, qint64)));
+    QObject::connect(this->reply, SIGNAL(sslErrors(QList<QSslError>)),
+                     this, SIGNAL(sslErrors(QList<QSslError>)));
+
+    /* Synchronous requests are finished before we get to connect to their
+     * signals, so pass everything on at once. */
+    if (this->reply->isFinished()) {
+        QObject::disconnect(this->reply, 0, this, 0);
+
+        if (this->reply->url().scheme() == "https")
+            this->onEncrypted();
+
+        this->onMetaDataChanged();
+
+        /* Everything received is still buffered in the reply. */
+        qint64 size = this->reply->bytesAvailable();
+        emit this->downloadProgress(size, size);
+
+        this->onFinished();
+    }
+}
+
+
+void TransportJob::cancel() {
+    if (this->cancelled)
+        return;
+
+    this->cancelled = true;
+
+    if (this->reply != NULL) {
+        QObject::disconnect(this->reply, 0, this, 0);
+        this->reply->abort();
+    }
+
+    this->deleteLater();
+}
+
+
+void TransportJob::onMetaDataChanged() {
+    /* Data read before the metadata changed belongs with the old metadata
+     * (which only happens with multiple responses, like "100 Continue"). */
+    this->flush();
+
+    TransportMeta meta;
+    meta.headers = this->reply->rawHeaderPairs();
+    meta.sslConfiguration = this->reply->sslConfiguration();
+
+    int count = sizeof(forwardedAttributes) / sizeof(forwardedAttributes[0]);
+    for (int i = 0; i < count; i++) {
+        QVariant value = this->reply->attribute(forwardedAttributes[i]);
+        if (value.isValid())
+            meta.attributes.insert(forwardedAttributes[i], value);
+    }
+
+    emit this->metaDataReady(meta);
+}
+
+
+void TransportJob::onReadyRead() {
+    this->pending.append(this->reply->readAll());
+
+    if (this->pending.size() >= chunkSize)
+        this->flush();
+    else if (!this->flushTimer->isActive())
+        this->flushTimer->start();
+}
+
+
+void TransportJob::onEncrypted() {
+    this->sessions->store(this->reply->url(), this->reply->sslConfiguration());
+}
+
+
+void TransportJob::onFinished() {
+    this->pending.append(this->reply->readAll());
+    this->flush();
+
+    emit this->done(int(this->reply->error()), this->reply->errorString());
+
+    this->deleteLater();
+}
+
+
+void TransportJob::flush() {
+    this->flushTimer->stop();
+
+    if (this->pending.isEmpty())
+        return;
+
+    emit this->dataReady(this->pending);
+    this->pending = QByteArray();
+}
+
+
+ThreadedReply::ThreadedReply(QNetworkAccessManager::Operation op,
+                             const QNetworkRequest & req,
+                             QNetworkCookieJar * jar,
+                             QObject * parent)
+                           : QNetworkReply(parent)
+                           , offset(0)
+                           , available(0)
+                           , jar(jar) {
+    this->setRequest(req);
+    this->setUrl(req.url());
+    this->setOperation(op);
+    this->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+
+void ThreadedReply::abort() {
+    if (this->isFinished())
+        return;
+
+    this->setError(OperationCanceledError, "Operation canceled");
+    this->setFinished(true);
+
+    emit this->error(OperationCanceledError);
+    emit this->finished();
+    emit this->abortRequested();
+}
+
+
+qint64 ThreadedReply::bytesAvailable() const {
+    return this->available + QNetworkReply::bytesAvailable();
+}
+
+
+void ThreadedReply::onMetaDataReady(TransportMeta meta) {
+    if (this->isFinished())
+        return;
+
+    for (int i = 0; i < meta.headers.size(); i++)
+        this->setRawHeader(meta.headers[i].first, meta.headers[i].second);
+
+    QHash<int, QVariant>::const_iterator it;
+    for (it = meta.attributes.constBegin(); it != meta.attributes.constEnd(); ++it)
+        this->setAttribute(QNetworkRequest::Attribute(it.key()), it.value());
+
+    this->ssl = meta.sslConfiguration;
+
+    /* Store received cookies, unless the request asked us not to. */
+    int save = this->request().attribute(QNetworkRequest::CookieSaveControlAttribute,
+                                         QNetworkRequest::Automatic).toInt();
+
+    if (this->jar != NULL && save == QNetworkRequest::Automatic) {
+        QList<QNetworkCookie> cookies = this->header(QNetworkRequest::SetCookieHeader)
+                                            .value<QList<QNetworkCookie> >();
+        if (!cookies.isEmpty())
+            this->jar->setCookiesFromUrl(cookies, this->url());
+    }
+
+    emit this->metaDataChanged();
+}
+
+
+void ThreadedReply::onDataReady(QByteArray data) {
+    if (this->isFinished())
+        return;
+
+    this->chunks.enqueue(data);
+    this->available += data.size();
+
+    emit this->readyRead();
+}
+
+
+void ThreadedReply::onSslErrors(QList<QSslError> errors) {
+    if (!this->isFinished())
+        emit this->sslErrors(errors);
+}
+
+
+void ThreadedReply::onDone(int error, QString message) {
+    if (this->isFinished())
+        return;
+
+    this->setFinished(true);
+
+    if (error != NoError) {
+        this->setError(NetworkError(error), message);
+        emit this->error(NetworkError(error));
+    }
+
+    emit this->readChannelFinished();
+    emit this->finished();
+}
+
+
+qint64 ThreadedReply::readData(char * data, qint64 maxlen) {
+    qint64 read = 0;
+
+    while (read < maxlen && !this->chunks.isEmpty()) {
+        const QByteArray & chunk = this->chunks.head();
+        int count = int(qMin(maxlen - read, qint64(chunk.size() - this->offset)));
+
+        memcpy(data + read, chunk.constData() + this->offset, count);
+        read += count;
+        this->offset += count;
+
+        if (this->offset == chunk.size()) {
+            this->chunks.dequeue();
+            this->offset = 0;
+        }
+    }
+
+    this->available -= read;
+
+    if (read == 0 && this->isFinished())
+        return -1;
+
+    return read;
+}
+
+
+void ThreadedReply::sslConfigurationImplementation(QSslConfiguration & config) const {
+    config = this->ssl;
+}
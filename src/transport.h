@@ -0,0 +1,215 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QNetworkAccessManager>
+#include <QNetworkCookieJar>
+#include <QNetworkReply>
+#include <QQueue>
+#include <QSslError>
+#include <QSslConfiguration>
+#include <QTimer>
+
+#include "./tls.h"
+
+
+/* Response metadata (headers and attributes) passed from the network thread
+ * to the GUI thread. */
+struct TransportMeta {
+    QList<QNetworkReply::RawHeaderPair> headers;
+    QHash<int, QVariant> attributes;
+    QSslConfiguration sslConfiguration;
+};
+
+Q_DECLARE_METATYPE(TransportMeta)
+
+
+/* The NetworkTransport class is the QNetworkAccessManager doing the actual
+ * network I/O for HTTP and HTTPS requests. It lives on a dedicated thread,
+ * so that socket reads never have to wait for WebKit to finish layout or
+ * script execution (and the other way around).
+ *
+ * The transport doesn't deal with cookies; that's left to the GUI thread,
+ * where the cookie jar lives. */
+class NetworkTransport : public QNetworkAccessManager {
+    Q_OBJECT
+
+private:
+    /* Where to store negotiated TLS session tickets. */
+    TlsSessionCache * sessions;
+
+    /* Managers sending requests through each of the pooled proxies, keyed
+     * by proxy name. Qt only lets us set a proxy per manager, and asking the
+     * proxy factory may happen well after the pool settled on a proxy. */
+    QHash<QString, NetworkTransport *> upstreams;
+
+public:
+    /* Constructs a new NetworkTransport. */
+    NetworkTransport(TlsSessionCache * sessions, QObject * parent = NULL)
+        : QNetworkAccessManager(parent)
+        , sessions(sessions) {
+    }
+
+    /* Start a request, through the named pooled proxy (if it's still in the
+     * pool) or whatever our proxy factory picks; called on the network
+     * thread by `TransportJob`. */
+    QNetworkReply * open(QNetworkAccessManager::Operation op,
+                         const QNetworkRequest & req, QIODevice * body,
+                         const QString & proxy);
+
+    /* Return the TLS session cache. */
+    TlsSessionCache * tlsSessions() const;
+
+public slots:
+    /* Start a job which has been moved to the network thread. */
+    void start(QObject * job);
+
+    /* Open a connection ahead of time. */
+    void preconnect(const QString & host, int port, bool encrypted,
+                    const QSslConfiguration & config);
+};
+
+
+/* A TransportJob runs a single request on the network thread, and forwards
+ * everything about its reply to a ThreadedReply on the GUI thread. Response
+ * data is collected into large chunks before being passed on, to keep the
+ * number of cross-thread events down. */
+class TransportJob : public QObject {
+    Q_OBJECT
+
+private:
+    QNetworkAccessManager::Operation op;
+    QNetworkRequest request;
+    QByteArray body;
+
+    /* Name of the pooled proxy to send the request through, if any. */
+    QString proxy;
+
+    /* The actual reply, once the request has been started. */
+    QNetworkReply * reply;
+
+    /* Data read but not yet passed on. */
+    QByteArray pending;
+    QTimer * flushTimer;
+
+    /* Whether the job has been cancelled from the GUI thread. */
+    bool cancelled;
+
+    TlsSessionCache * sessions;
+
+public:
+    /* Constructs a new TransportJob. */
+    TransportJob(QNetworkAccessManager::Operation op, const QNetworkRequest & req,
+                 const QByteArray & body, const QString & proxy)
+        : QObject(NULL)
+        , op(op)
+        , request(req)
+        , body(body)
+        , proxy(proxy)
+        , reply(NULL)
+        , flushTimer(NULL)
+        , cancelled(false)
+        , sessions(NULL) {
+    }
+
+    /* Start the request through a transport; called on the network thread. */
+    void start(NetworkTransport * transport);
+
+public slots:
+    /* Abort the request, and get rid of the job. */
+    void cancel();
+
+signals:
+    /* Signals forwarding the reply's progress. */
+    void metaDataReady(TransportMeta meta);
+    void dataReady(QByteArray data);
+    void downloadProgress(qint64 received, qint64 total);
+    void uploadProgress(qint64 sent, qint64 total);
+    void sslErrors(QList<QSslError> errors);
+    void done(int error, QString message);
+
+private slots:
+    void onMetaDataChanged();
+    void onReadyRead();
+    void onEncrypted();
+    void onFinished();
+
+    /* Pass on all pending data. */
+    void flush();
+};
+
+
+/* The ThreadedReply class is what the GUI thread sees of a request running
+ * on the network thread. It takes care of cookies, just like a regular
+ * QNetworkAccessManager reply would.
+ *
+ * SSL errors are passed on, but only after the network thread has already
+ * decided how to deal with them (which is to fail the request), so calling
+ * `ignoreSslErrors` has no effect. Authentication requests aren't passed on
+ * at all, as the network thread can't wait for credentials from this one;
+ * requests needing authentication fail with an authentication error. */
+class ThreadedReply : public QNetworkReply {
+    Q_OBJECT
+
+private:
+    /* Received chunks of data not yet read, and how much of the first
+     * chunk has been read already. */
+    QQueue<QByteArray> chunks;
+    int offset;
+    qint64 available;
+
+    /* SSL configuration of the connection. */
+    QSslConfiguration ssl;
+
+    /* Cookie jar to store received cookies in, if any. */
+    QNetworkCookieJar * jar;
+
+public:
+    /* Constructs a new ThreadedReply. */
+    ThreadedReply(QNetworkAccessManager::Operation op, const QNetworkRequest & req,
+                  QNetworkCookieJar * jar, QObject * parent = NULL);
+
+    /* Aborts the request. */
+    void abort();
+
+    /* Number of bytes which can be read without blocking. */
+    qint64 bytesAvailable() const;
+
+    /* Replies are always sequential. */
+    bool isSequential() const {
+        return true;
+    }
+
+public slots:
+    /* Receivers for TransportJob signals. */
+    void onMetaDataReady(TransportMeta meta);
+    void onDataReady(QByteArray data);
+    void onSslErrors(QList<QSslError> errors);
+    void onDone(int error, QString message);
+
+signals:
+    /* Signal emitted when the request should be aborted. */
+    void abortRequested();
+
+protected:
+    /* Reads incoming data. */
+    qint64 readData(char * data, qint64 maxlen);
+
+    /* Returns the connection's SSL configuration. */
+    void sslConfigurationImplementation(QSslConfiguration & config) const;
+};
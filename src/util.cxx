@@ -30,3 +30,22 @@ QString readFileUtf8(const QString path, QByteArray & buf) {
 
     return QString();
 }
+
+
+quint64 fnv1a(const QByteArray & bytes) {
+    quint64 hash = fnvOffset;
+
+    for (int i = 0; i < bytes.size(); i++) {
+        hash ^= quint8(bytes[i]);
+        hash *= fnvPrime;
+    }
+
+    return hash;
+}
+
+
+quint64 mix64(quint64 x) {
+    x = (x ^ (x >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+}
@@ -20,3 +20,16 @@
 
 /* Read a UTF-8 encoded file from disk (or from the QRC store). */
 QString readFileUtf8(const QString path, QByteArray & buf);
+
+
+/* Offset basis and prime of the 64-bit FNV-1a hash, for hashing data as it
+ * comes in rather than all at once with `fnv1a`. */
+const quint64 fnvOffset = Q_UINT64_C(14695981039346656037);
+const quint64 fnvPrime = Q_UINT64_C(1099511628211);
+
+/* Return the 64-bit FNV-1a hash of a byte string. */
+quint64 fnv1a(const QByteArray & bytes);
+
+/* Scramble a 64-bit hash, spreading its bits, for deriving further hashes
+ * from it. This is the finalizer of the SplitMix64 generator. */
+quint64 mix64(quint64 x);